@@ -0,0 +1,57 @@
+//****** Global new/delete tracking ******//
+
+//NOTES :
+//1. The #define new new(__FILE__, __LINE__) macro only tags the `new` written in our own files.
+//   std::vector, std::string, make_shared, and any library allocate through the plain global
+//   operator new, so the tracker never saw them.
+//2. mem_tracker.cpp replaces every global operator new/delete (plain, array, nothrow, aligned,
+//   sized). setGlobalTracking(true) records the untagged ones too, keyed by the caller's address.
+//3. Reentrancy : the tracker's own bookkeeping (reports, vectors, streams) runs with a thread_local
+//   guard set, its allocations are not recorded, so it never recurses into itself.
+//4. Below : a shared_ptr cycle leaks, which the macro alone can't see.
+
+//Compile : g++ -std=c++17 -O2 -rdynamic global_tracking_demo.cpp mem_tracker.cpp
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include "mem_tracker.h"
+
+struct Peer {
+    std::shared_ptr<Peer> other; // A cycle of shared_ptr never reaches count 0.
+    std::string name;
+};
+
+struct alignas(64) CacheLine {
+    long counters[8];
+};
+
+int main() {
+    setGlobalTracking(true);
+    enableHeapProfile(true);
+
+    {
+        std::vector<std::string> names;
+        for (int i = 0; i < 1000; ++i)
+            names.push_back("a name long enough to leave SSO " + std::to_string(i));
+        std::unordered_map<int, std::string> byId;
+        for (int i = 0; i < 1000; ++i)
+            byId[i] = names[i];
+        auto lines = std::make_unique<CacheLine[]>(16); // Aligned new.
+        std::cout << "Live while the containers exist : " << trackedAllocationCount() << " allocations\n";
+    }
+    std::cout << "Live after they are destroyed    : " << trackedAllocationCount() << " allocations\n";
+
+    auto a = std::make_shared<Peer>();
+    auto b = std::make_shared<Peer>();
+    a->other = b;
+    b->other = a;
+    a.reset();
+    b.reset();
+
+    printHeapProfile(std::cout, 5);
+    checkLeaks();
+    return 0;
+}
@@ -1,59 +1,1064 @@
 #include "mem_tracker.h"
 #include <iostream>
-#include <unordered_map>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <execinfo.h> // backtrace
+#include <cxxabi.h>   // __cxa_demangle
 #include <cstdlib> // malloc & free
 #include <new>    // std::bad_alloc
  
-std::unordered_map<void*, Allocation> allocMap;
+// Allocation table : 64 shards, each one an open-addressing hash table (linear probing) behind
+// its own spinlock. The shard is picked from the pointer hash, so threads allocating at the same
+// time almost never touch the same lock. Entries live inline in the slot array : no node is
+// allocated per entry, the array only grows (with malloc, not new) when a shard gets 70% full.
+namespace {
+ 
+constexpr size_t kShardBits = 6;
+constexpr size_t kShards = size_t(1) << kShardBits;
+constexpr size_t kInitialSlots = 256;
+constexpr size_t kPresenceBits = 12; // Counters per shard : 4096, so 262144 in all (1 MB, zero-initialized).
+ 
+void* const kTombstone = reinterpret_cast<void*>(1); // Erased slot, keeps probe chains intact.
+ 
+struct Slot {
+    void* ptr; // nullptr = empty
+    Allocation info;
+};
+ 
+struct alignas(64) Shard {
+    std::atomic_flag busy = ATOMIC_FLAG_INIT;
+    Slot* slots = nullptr;
+    size_t capacity = 0; // Power of two.
+    size_t used = 0;     // Live entries.
+    size_t tombstones = 0;
+ 
+    // Counting filter : how many recorded pointers hash to each counter. A delete whose counter is
+    // 0 was never recorded (sampled out, or not from the tracked new), so it skips the lock and the
+    // probe. Only written under the lock, so plain load + store, no atomic read-modify-write.
+    // With L live records over all 262144 counters, about exp(-L / 262144) of the untracked deletes
+    // are turned away : ~96% at 10k records, ~68% at 100k, ~2% at 1M. Past a few hundred thousand
+    // live records (Full mode on a big heap) it stops helping and every delete takes the lock. In
+    // Sampled mode the live records stay few and it turns away nearly everything.
+    std::atomic<uint32_t> presence[size_t(1) << kPresenceBits] = {};
+ 
+    void lock() {
+        for (int spins = 0; busy.test_and_set(std::memory_order_acquire); ++spins)
+            if (spins >= 64)
+                std::this_thread::yield(); // Holder may be descheduled, don't burn its time slice.
+    }
+    void unlock() { busy.clear(std::memory_order_release); }
+};
+ 
+Shard shards[kShards]; // Constant initialized : usable before main() starts.
+ 
+// Fibonacci hashing : heap pointers are 16-byte aligned, the multiply spreads the useful bits.
+inline uint64_t hashPointer(void* ptr) {
+    return (reinterpret_cast<uintptr_t>(ptr) >> 4) * 0x9E3779B97F4A7C15ull;
+}
+ 
+inline Shard& shardFor(uint64_t hash) {
+    return shards[hash >> (64 - kShardBits)];
+}
+ 
+inline std::atomic<uint32_t>& presenceFor(Shard& shard, uint64_t hash) {
+    return shard.presence[(hash >> 20) & ((size_t(1) << kPresenceBits) - 1)]; // Not the shard's bits.
+}
+ 
+// Called with the shard locked.
+inline void addPresence(std::atomic<uint32_t>& counter, int32_t delta) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+ 
+// Called with the shard locked. Returns false if memory for the table itself ran out.
+bool grow(Shard& shard) {
+    size_t newCapacity = shard.capacity ? shard.capacity * 2 : kInitialSlots;
+    if (shard.used * 2 < shard.capacity)
+        newCapacity = shard.capacity; // Mostly tombstones : rehash in place size.
+    Slot* fresh = static_cast<Slot*>(calloc(newCapacity, sizeof(Slot)));
+    if (!fresh)
+        return false;
+    for (size_t i = 0; i < shard.capacity; ++i) {
+        void* p = shard.slots[i].ptr;
+        if (p == nullptr || p == kTombstone)
+            continue;
+        size_t j = hashPointer(p) & (newCapacity - 1);
+        while (fresh[j].ptr)
+            j = (j + 1) & (newCapacity - 1);
+        fresh[j] = shard.slots[i];
+    }
+    free(shard.slots);
+    shard.slots = fresh;
+    shard.capacity = newCapacity;
+    shard.tombstones = 0;
+    return true;
+}
+ 
+void tableInsert(void* ptr, const Allocation& info) {
+    uint64_t h = hashPointer(ptr);
+    Shard& shard = shardFor(h);
+    shard.lock();
+    if ((shard.used + shard.tombstones + 1) * 10 > shard.capacity * 7 && !grow(shard)) {
+        shard.unlock();
+        return; // Out of memory for bookkeeping : the allocation just goes untracked.
+    }
+    size_t mask = shard.capacity - 1;
+    size_t i = h & mask;
+    Slot* reuse = nullptr;
+    for (;; i = (i + 1) & mask) {
+        void* p = shard.slots[i].ptr;
+        if (p == ptr) { // Same address recorded twice (missed delete) : overwrite.
+            shard.slots[i].info = info;
+            shard.unlock();
+            return;
+        }
+        if (p == kTombstone && !reuse)
+            reuse = &shard.slots[i];
+        if (p == nullptr)
+            break;
+    }
+    Slot* slot = reuse ? reuse : &shard.slots[i];
+    if (reuse)
+        --shard.tombstones;
+    slot->ptr = ptr;
+    slot->info = info;
+    ++shard.used;
+    addPresence(presenceFor(shard, h), 1);
+    shard.unlock();
+}
+ 
+bool tableErase(void* ptr) {
+    uint64_t h = hashPointer(ptr);
+    Shard& shard = shardFor(h);
+    if (presenceFor(shard, h).load(std::memory_order_relaxed) == 0)
+        return false;
+    shard.lock();
+    bool found = false;
+    if (shard.capacity) {
+        size_t mask = shard.capacity - 1;
+        for (size_t i = h & mask; shard.slots[i].ptr; i = (i + 1) & mask) {
+            if (shard.slots[i].ptr == ptr) {
+                shard.slots[i].ptr = kTombstone;
+                --shard.used;
+                ++shard.tombstones;
+                addPresence(presenceFor(shard, h), -1);
+                found = true;
+                break;
+            }
+        }
+    }
+    shard.unlock();
+    return found;
+}
+ 
+// Calls fn(ptr, info) for every recorded allocation. Each shard is copied under ONE lock (so a
+// concurrent grow() can't make the scan skip or repeat entries) into a malloc'd buffer, and fn runs
+// unlocked : it may print, and a stream may free memory, and that delete needs a shard lock too.
+template<class Fn>
+void forEachEntry(Fn fn) {
+    for (Shard& shard : shards) {
+        shard.lock();
+        size_t count = 0;
+        Slot* copy = shard.used ? static_cast<Slot*>(malloc(shard.used * sizeof(Slot))) : nullptr;
+        if (copy)
+            for (size_t i = 0; i < shard.capacity; ++i)
+                if (shard.slots[i].ptr != nullptr && shard.slots[i].ptr != kTombstone)
+                    copy[count++] = shard.slots[i];
+        shard.unlock();
+        for (size_t i = 0; i < count; ++i)
+            fn(copy[i].ptr, copy[i].info);
+        free(copy);
+    }
+}
+ 
+// Set while the tracker itself runs (recording, reports) : an operator new called from there is not
+// recorded, so the bookkeeping can never recurse into itself.
+thread_local bool insideTracker = false;
+ 
+struct TrackerScope {
+    bool outer;
+    TrackerScope() : outer(insideTracker) { insideTracker = true; }
+    ~TrackerScope() { insideTracker = outer; }
+};
+ 
+// File name of allocations made without the macro (global tracking mode).
+const char* const kUntaggedFile = "(untagged new)";
+std::atomic<bool> globalTracking{false};
+ 
+// Heap profile : call sites live in a fixed array used as an open-addressing table. A slot is
+// claimed with a CAS on its key, the claiming thread fills file/line/stack and then sets `ready`.
+// Counters are atomics, so threads hitting the same site never lock.
+constexpr size_t kMaxSites = 2048;
+constexpr int kMaxStackDepth = 24;
+constexpr size_t kSizeClasses = 32; // Class k holds sizes in [2^(k-1), 2^k), the last one the rest.
+ 
+struct CallSite {
+    std::atomic<uint64_t> key{0}; // 0 = free
+    std::atomic<bool> ready{false};
+    const char* file;
+    int line;
+    int depth;
+    void* stack[kMaxStackDepth]; // Innermost first. With stackDepth 0 only the caller of new.
+    std::atomic<uint64_t> allocations{0}, bytes{0};
+    std::atomic<uint64_t> sizeClasses[kSizeClasses] = {};
+};
+ 
+CallSite sites[kMaxSites];
+std::atomic<int> profileDepth{-1}; // -1 = profiling off
+std::atomic<uint64_t> droppedSites{0};
+ 
+inline size_t sizeClassOf(size_t size) {
+    size_t k = size ? 64 - __builtin_clzll(size) : 0;
+    return k < kSizeClasses ? k : kSizeClasses - 1;
+}
+ 
+// Stack starting at `caller` (the return address in the code that called new).
+int captureStack(void* caller, int depth, void** out) {
+    if (depth <= 0) {
+        out[0] = caller;
+        return 1;
+    }
+    void* raw[kMaxStackDepth + 8];
+    int n = backtrace(raw, std::min(depth, kMaxStackDepth) + 8);
+    int start = 0;
+    while (start < n && raw[start] != caller)
+        ++start; // Drop the tracker's own frames.
+    if (start == n)
+        start = 0;
+    int count = std::min(n - start, std::min(depth, kMaxStackDepth));
+    std::copy(raw + start, raw + start + count, out);
+    return count;
+}
+ 
+// Finds or claims the slot for `key` in a fixed open-addressing table of sites (key 0 = free).
+// The thread that claims a slot fills it, then publishes it with `ready`.
+template<class Site, size_t N, class Fill>
+int claimSite(Site (&table)[N], uint64_t key, Fill fill) {
+    for (size_t probe = 0, i = key & (N - 1); probe < N; ++probe, i = (i + 1) & (N - 1)) {
+        Site& site = table[i];
+        uint64_t current = site.key.load(std::memory_order_acquire);
+        if (current == 0 && site.key.compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+            fill(site);
+            site.ready.store(true, std::memory_order_release);
+            return static_cast<int>(i);
+        }
+        if (current == key)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+ 
+int siteFor(const char* file, int line, void* caller, int depth) {
+    void* stack[kMaxStackDepth];
+    int count = captureStack(caller, depth, stack);
+    uint64_t h = reinterpret_cast<uintptr_t>(file) * 0x9E3779B97F4A7C15ull ^ uint64_t(line) * 0xC2B2AE3D27D4EB4Full;
+    if (depth > 0 || file == kUntaggedFile) // Else the site is just file:line, whatever the caller PC.
+        for (int i = 0; i < count; ++i)
+            h = (h ^ reinterpret_cast<uintptr_t>(stack[i])) * 0x100000001B3ull;
+    h |= 1;
+ 
+    int index = claimSite(sites, h, [&](CallSite& site) {
+        site.file = file;
+        site.line = line;
+        site.depth = count;
+        std::copy(stack, stack + count, site.stack);
+    });
+    if (index < 0)
+        droppedSites.fetch_add(1, std::memory_order_relaxed);
+    return index;
+}
+ 
+void profileAllocation(Allocation& info, void* caller) {
+    int depth = profileDepth.load(std::memory_order_relaxed);
+    if (depth < 0)
+        return;
+    info.site = siteFor(info.file, info.line, caller, depth);
+    if (info.site < 0)
+        return;
+    CallSite& site = sites[info.site];
+    uint64_t count = static_cast<uint64_t>(info.weight + 0.5);
+    site.allocations.fetch_add(count, std::memory_order_relaxed);
+    site.bytes.fetch_add(static_cast<uint64_t>(info.weight * double(info.size) + 0.5), std::memory_order_relaxed);
+    site.sizeClasses[sizeClassOf(info.size)].fetch_add(count, std::memory_order_relaxed);
+}
+ 
+// Sampling : 0 = record everything, else the mean number of bytes between two samples.
+std::atomic<size_t> sampleInterval{0};
+ 
+// Bytes this thread may still allocate before the next sample. Trivial type : no TLS init guard.
+thread_local int64_t bytesUntilSample = 0;
+thread_local uint64_t samplerState = 0;
+thread_local bool firstGapDrawn = false; // In Sampled mode, bytesUntilSample holds a real gap.
+ 
+// Exponential gap with mean `interval` : sampling then acts like a Poisson process over the bytes,
+// so every byte has the same chance to be picked whatever the allocation sizes are.
+int64_t nextSampleGap(size_t interval) {
+    if (samplerState == 0) // Seed per thread.
+        samplerState = (reinterpret_cast<uintptr_t>(&samplerState) ^
+                        static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count())) | 1;
+    samplerState ^= samplerState << 13; // xorshift64
+    samplerState ^= samplerState >> 7;
+    samplerState ^= samplerState << 17;
+    double u = double((samplerState >> 11) + 1) / double(uint64_t(1) << 53); // (0, 1]
+    return static_cast<int64_t>(-std::log(u) * double(interval)) + 1;
+}
+ 
+// Slow path : the byte counter ran out (or full tracking is on).
+void sampleAllocation(void* ptr, size_t size, const char* file, int line, void* caller) {
+    TrackerScope scope;
+    Allocation info{size, file, line, 1.0};
+    size_t interval = sampleInterval.load(std::memory_order_relaxed);
+    if (interval == 0) {
+        bytesUntilSample = 0; // Stay on the slow path : record everything.
+        firstGapDrawn = false;
+    }
+    else {
+        // First time here in Sampled mode, bytesUntilSample was only 0 : draw the first gap from
+        // the start of this allocation, and sample it only if that gap ends inside it. Sampling it
+        // outright would pick every thread's first allocation, with a large weight.
+        if (!firstGapDrawn) {
+            firstGapDrawn = true;
+            if ((bytesUntilSample += nextSampleGap(interval)) > 0)
+                return;
+        }
+        // Skip every sample point that fell inside this allocation : it is sampled once, and the
+        // next allocation must not be picked because of points that were not in it.
+        do
+            bytesUntilSample += nextSampleGap(interval);
+        while (bytesUntilSample <= 0);
+        // An allocation of `size` bytes is picked with probability 1 - exp(-size / interval),
+        // so one sample stands for 1 / that many allocations like it.
+        double probability = 1.0 - std::exp(-double(size) / double(interval));
+        info.weight = probability > 0 ? 1.0 / probability : 1.0;
+    }
+    profileAllocation(info, caller);
+    tableInsert(ptr, info);
+}
+ 
+// Fast path : one decrement and one compare per unsampled allocation.
+inline void recordAllocation(void* ptr, size_t size, const char* file, int line, void* caller) {
+    if ((bytesUntilSample -= static_cast<int64_t>(size)) > 0)
+        return;
+    sampleAllocation(ptr, size, file, line, caller);
+}
+ 
+} // namespace
  
 void logAllocation(void* ptr, size_t size, const char* file, int line) {
-    allocMap[ptr] = {size, file, line};
+    recordAllocation(ptr, size, file, line, __builtin_return_address(0));
     //When new is called, this function stores the pointer along with allocation details.
 }
  
 void logDeallocation(void* ptr) {
-    allocMap.erase(ptr);
-    //When delete is called, it removes the pointer from allocMap
+    tableErase(ptr);
+    //When delete is called, it removes the pointer from the allocation table
+}
+ 
+void setGlobalTracking(bool on) {
+    globalTracking.store(on, std::memory_order_relaxed);
+}
+ 
+void setTrackingMode(TrackingMode mode, size_t sampleEveryBytes) {
+    sampleInterval.store(mode == TrackingMode::Full || sampleEveryBytes == 0 ? 0 : sampleEveryBytes,
+                         std::memory_order_relaxed);
+    bytesUntilSample = 0; // The calling thread switches at once, the others at their next sample.
+    firstGapDrawn = false;
+}
+ 
+size_t trackedAllocationCount() {
+    size_t count = 0;
+    for (Shard& shard : shards) {
+        shard.lock();
+        count += shard.used;
+        shard.unlock();
+    }
+    return count;
+}
+ 
+HeapEstimate liveHeapEstimate() {
+    HeapEstimate e{0, 0, 0};
+    forEachEntry([&e](void*, const Allocation& info) {
+        e.bytes += info.weight * double(info.size);
+        e.allocations += info.weight;
+        ++e.records;
+    });
+    return e;
 }
  
 void checkLeaks() {
-    if (allocMap.empty()) {
-        std::cout << "No memory leaks detected.\n";
+    TrackerScope scope;
+    bool sampled = sampleInterval.load(std::memory_order_relaxed) != 0;
+    HeapEstimate total{0, 0, 0};
+    forEachEntry([&](void* ptr, const Allocation& info) {
+        std::cerr << "Leak detected: " << info.size << " bytes at "
+                  << info.file << ":" << info.line
+                  << " (" << ptr << ")";
+        if (info.weight != 1.0)
+            std::cerr << " sampled, stands for ~" << info.weight * double(info.size) << " bytes";
+        std::cerr << "\n";
+        total.bytes += info.weight * double(info.size);
+        total.allocations += info.weight;
+        ++total.records;
+    });
+    if (total.records == 0)
+        std::cout << "No memory leaks detected" << (sampled ? " in the sampled allocations.\n" : ".\n");
+    else if (sampled)
+        std::cerr << "Estimated leak : ~" << total.bytes << " bytes in ~" << total.allocations
+                  << " allocations (" << total.records << " samples)\n";
+}
+
+void enableHeapProfile(bool on, int stackDepth) {
+    if (on && stackDepth > 0) {
+        void* warmup[1];
+        backtrace(warmup, 1); // First call loads libgcc : do it now, not inside an allocation.
+    }
+    profileDepth.store(on ? std::max(0, std::min(stackDepth, kMaxStackDepth)) : -1, std::memory_order_relaxed);
+}
+ 
+namespace {
+ 
+struct SiteRow {
+    const char* file;
+    int line;
+    int site; // -1 : live allocations recorded while profiling was off, grouped by file:line.
+    double liveBytes = 0, liveCount = 0;
+    uint64_t allocatedBytes = 0, allocatedCount = 0;
+};
+ 
+std::vector<SiteRow> collectRows() {
+    std::vector<SiteRow> rows;
+    std::vector<int> rowOfSite(kMaxSites, -1);
+    for (size_t i = 0; i < kMaxSites; ++i) {
+        if (!sites[i].ready.load(std::memory_order_acquire))
+            continue;
+        rowOfSite[i] = static_cast<int>(rows.size());
+        SiteRow row{sites[i].file, sites[i].line, static_cast<int>(i)};
+        row.allocatedBytes = sites[i].bytes.load(std::memory_order_relaxed);
+        row.allocatedCount = sites[i].allocations.load(std::memory_order_relaxed);
+        rows.push_back(row);
+    }
+    std::map<std::pair<const char*, int>, SiteRow> unprofiled;
+    forEachEntry([&](void*, const Allocation& info) {
+        SiteRow* row;
+        if (info.site >= 0 && rowOfSite[info.site] >= 0) {
+            row = &rows[rowOfSite[info.site]];
+        }
+        else {
+            auto key = std::make_pair(info.file, info.line);
+            row = &unprofiled.emplace(key, SiteRow{info.file, info.line, -1}).first->second;
+        }
+        row->liveBytes += info.weight * double(info.size);
+        row->liveCount += info.weight;
+    });
+    for (auto& entry : unprofiled)
+        rows.push_back(entry.second);
+    return rows;
+}
+ 
+double metricOf(const SiteRow& row, HeapMetric metric) {
+    switch (metric) {
+    case HeapMetric::LiveBytes: return row.liveBytes;
+    case HeapMetric::LiveCount: return row.liveCount;
+    case HeapMetric::AllocatedBytes: return double(row.allocatedBytes);
+    case HeapMetric::AllocatedCount: return double(row.allocatedCount);
+    }
+    return 0;
+}
+ 
+// "binary(mangled+0x1f) [0x...]" -> demangled name, or the address when there is no symbol.
+std::string frameName(const char* symbol, void* address) {
+    std::string text = symbol ? symbol : "";
+    size_t open = text.find('('), plus = text.find('+', open);
+    if (open != std::string::npos && plus != std::string::npos && plus > open + 1) {
+        std::string mangled = text.substr(open + 1, plus - open - 1);
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status);
+        std::string name = status == 0 && demangled ? demangled : mangled;
+        free(demangled);
+        return name;
+    }
+    char hex[32];
+    snprintf(hex, sizeof hex, "%p", address);
+    return hex;
+}
+ 
+} // namespace
+ 
+void printHeapProfile(std::ostream& out, size_t topSites) {
+    TrackerScope scope;
+    std::vector<SiteRow> rows = collectRows();
+    std::sort(rows.begin(), rows.end(), [](const SiteRow& a, const SiteRow& b) { return a.liveBytes > b.liveBytes; });
+    double liveBytes = 0, liveCount = 0;
+    for (const SiteRow& row : rows) {
+        liveBytes += row.liveBytes;
+        liveCount += row.liveCount;
+    }
+    bool sampled = sampleInterval.load(std::memory_order_relaxed) != 0;
+    out << "Heap profile" << (sampled ? " (sampled, estimates)" : "") << " : " << uint64_t(liveBytes + 0.5)
+        << " live bytes in " << uint64_t(liveCount + 0.5) << " allocations, " << rows.size() << " call sites\n";
+    for (size_t r = 0; r < rows.size() && r < topSites; ++r) {
+        const SiteRow& row = rows[r];
+        out << "  " << row.file << ":" << row.line;
+        if (row.site >= 0 && row.file == kUntaggedFile)
+            out << " @ " << sites[row.site].stack[0];
+        out << "  live " << uint64_t(row.liveBytes + 0.5) << " B in "
+            << uint64_t(row.liveCount + 0.5);
+        if (row.site >= 0) {
+            out << " | allocated " << row.allocatedBytes << " B in " << row.allocatedCount << " | sizes";
+            const CallSite& site = sites[row.site];
+            for (size_t k = 0; k < kSizeClasses; ++k) {
+                uint64_t n = site.sizeClasses[k].load(std::memory_order_relaxed);
+                if (n == 0)
+                    continue;
+                if (k == 0)
+                    out << " 0:" << n;
+                else if (k == kSizeClasses - 1)
+                    out << " " << (uint64_t(1) << (k - 1)) << "+:" << n;
+                else
+                    out << " " << (uint64_t(1) << (k - 1)) << "-" << ((uint64_t(1) << k) - 1) << ":" << n;
+            }
+        }
+        out << "\n";
+    }
+    if (uint64_t dropped = droppedSites.load(std::memory_order_relaxed))
+        out << "  (" << dropped << " allocations had no free call site slot)\n";
+}
+ 
+void writeFoldedStacks(std::ostream& out, HeapMetric metric) {
+    TrackerScope scope;
+    bool withStacks = profileDepth.load(std::memory_order_relaxed) > 0;
+    for (const SiteRow& row : collectRows()) {
+        double value = metricOf(row, metric);
+        if (value < 0.5)
+            continue;
+        std::string line;
+        if (withStacks && row.site >= 0) {
+            const CallSite& site = sites[row.site];
+            char** symbols = backtrace_symbols(const_cast<void* const*>(site.stack), site.depth);
+            for (int i = site.depth - 1; i >= 0; --i) // Root first.
+                line += frameName(symbols ? symbols[i] : nullptr, site.stack[i]) + ";";
+            free(symbols);
+        }
+        out << line << row.file << ":" << row.line << " " << uint64_t(value + 0.5) << "\n";
+    }
+}
+ 
+void writePprofHeapProfile(std::ostream& out) {
+    TrackerScope scope;
+    std::vector<SiteRow> rows = collectRows();
+    double liveBytes = 0, liveCount = 0, allocatedBytes = 0, allocatedCount = 0;
+    for (const SiteRow& row : rows) {
+        if (row.site < 0)
+            continue; // No address to attribute it to.
+        liveBytes += row.liveBytes;
+        liveCount += row.liveCount;
+        allocatedBytes += double(row.allocatedBytes);
+        allocatedCount += double(row.allocatedCount);
+    }
+    char buffer[128];
+    snprintf(buffer, sizeof buffer, "heap profile: %llu: %llu [%llu: %llu] @ heapprofile\n",
+             (unsigned long long)(liveCount + 0.5), (unsigned long long)(liveBytes + 0.5),
+             (unsigned long long)(allocatedCount + 0.5), (unsigned long long)(allocatedBytes + 0.5));
+    out << buffer;
+    for (const SiteRow& row : rows) {
+        if (row.site < 0)
+            continue;
+        const CallSite& site = sites[row.site];
+        snprintf(buffer, sizeof buffer, "%llu: %llu [%llu: %llu] @", (unsigned long long)(row.liveCount + 0.5),
+                 (unsigned long long)(row.liveBytes + 0.5), (unsigned long long)row.allocatedCount,
+                 (unsigned long long)row.allocatedBytes);
+        out << buffer;
+        for (int i = 0; i < site.depth; ++i) {
+            snprintf(buffer, sizeof buffer, " %p", site.stack[i]);
+            out << buffer;
+        }
+        out << "\n";
+    }
+    out << "\nMAPPED_LIBRARIES:\n";
+    std::ifstream maps("/proc/self/maps");
+    out << maps.rdbuf();
+}
+ 
+// Telemetry : every operator new is counted per size class and per call site, in counters owned
+// by the allocating thread. A counter has one writer, so an update is a plain load + store (no
+// lock prefix, no cache line bouncing). Readers (snapshots) just load them.
+//   a. A thread claims one of kTelemetryThreads blocks on its first allocation and gives it back
+//      when it exits. The counts stay in the block, the next owner keeps adding to them.
+//   b. Call sites go through a small direct-mapped cache in the block. When two sites collide the
+//      old one is flushed into the global telemetry site table (atomic adds, rare).
+//   c. Past kTelemetryThreads live threads, or while a thread is being torn down, the shared
+//      overflow block is used with atomic adds.
+namespace {
+ 
+constexpr size_t kTelemetryThreads = 256;
+constexpr size_t kSiteCacheSize = 64;
+constexpr size_t kMaxTelemetrySites = 1024;
+ 
+std::atomic<bool> telemetryOn{false};
+std::atomic<int64_t> telemetryStartNs{0};
+ 
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+ 
+// `where` is the line for tagged allocations, the caller's address for untagged ones.
+struct TelemetrySite {
+    std::atomic<uint64_t> key{0};
+    std::atomic<bool> ready{false};
+    const char* file;
+    uintptr_t where;
+    std::atomic<uint64_t> allocations{0}, bytes{0};
+};
+ 
+TelemetrySite telemetrySites[kMaxTelemetrySites];
+ 
+struct SiteCacheEntry {
+    std::atomic<const char*> file{nullptr};
+    std::atomic<uintptr_t> where{0};
+    std::atomic<uint64_t> allocations{0}, bytes{0};
+};
+ 
+struct alignas(64) ThreadTelemetry {
+    explicit ThreadTelemetry(bool shared = false) : shared(shared) {}
+ 
+    std::atomic<bool> inUse{false};
+    const bool shared; // The overflow block : several writers.
+    std::atomic<uint64_t> allocations[kSizeClasses] = {};
+    std::atomic<uint64_t> bytes[kSizeClasses] = {};
+    std::atomic<uint64_t> frees{0};
+    SiteCacheEntry siteCache[kSiteCacheSize];
+};
+ 
+ThreadTelemetry telemetryBlocks[kTelemetryThreads];
+ThreadTelemetry overflowTelemetry(true);
+ 
+thread_local ThreadTelemetry* tlsTelemetry = nullptr; // Trivial : no TLS init guard on the fast path.
+ 
+inline void bump(std::atomic<uint64_t>& counter, uint64_t value, bool shared) {
+    if (shared)
+        counter.fetch_add(value, std::memory_order_relaxed);
+    else
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+ 
+inline uint64_t siteKey(const char* file, uintptr_t where) {
+    return (reinterpret_cast<uintptr_t>(file) * 0x9E3779B97F4A7C15ull ^ where * 0xC2B2AE3D27D4EB4Full) | 1;
+}
+ 
+void addToGlobalSite(const char* file, uintptr_t where, uint64_t allocations, uint64_t bytes) {
+    int index = claimSite(telemetrySites, siteKey(file, where), [&](TelemetrySite& site) {
+        site.file = file;
+        site.where = where;
+    });
+    if (index < 0)
+        return; // Table full : the size class counters still have it.
+    // Release : a snapshot that sees these adds also sees the cache entry they came from unpublished.
+    telemetrySites[index].allocations.fetch_add(allocations, std::memory_order_release);
+    telemetrySites[index].bytes.fetch_add(bytes, std::memory_order_release);
+}
+ 
+// Gives the block back when the thread exits. Later allocations of this thread go to overflow.
+struct TelemetryOwner {
+    ~TelemetryOwner() {
+        if (tlsTelemetry && !tlsTelemetry->shared)
+            tlsTelemetry->inUse.store(false, std::memory_order_release);
+        tlsTelemetry = &overflowTelemetry;
+    }
+};
+ 
+ThreadTelemetry* claimTelemetry() {
+    for (ThreadTelemetry& block : telemetryBlocks) {
+        bool expected = false;
+        if (!block.inUse.load(std::memory_order_relaxed) &&
+            block.inUse.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            tlsTelemetry = &block;
+            thread_local TelemetryOwner owner; // Registers the exit hook, once per thread.
+            (void)owner;
+            return &block;
+        }
+    }
+    tlsTelemetry = &overflowTelemetry;
+    return tlsTelemetry;
+}
+ 
+inline void countAllocation(size_t size, const char* file, uintptr_t where) {
+    ThreadTelemetry* t = tlsTelemetry;
+    if (!t)
+        t = claimTelemetry();
+    size_t k = sizeClassOf(size);
+    bump(t->allocations[k], 1, t->shared);
+    bump(t->bytes[k], size, t->shared);
+    if (t->shared) {
+        addToGlobalSite(file, where, 1, size);
         return;
     }
-    for (const auto& entry : allocMap) {
-        std::cerr << "Leak detected: " << entry.second.size << " bytes at "
-                  << entry.second.file << ":" << entry.second.line
-                  << " (" << entry.first << ")\n";
+    SiteCacheEntry& e = t->siteCache[(siteKey(file, where) >> 20) & (kSiteCacheSize - 1)];
+    const char* cachedFile = e.file.load(std::memory_order_relaxed);
+    if (cachedFile != file || e.where.load(std::memory_order_relaxed) != where) {
+        // Unpublish first (readers skip the entry), then flush : a snapshot sees the counts here, in
+        // the global table, or (for a moment) nowhere, but never in both.
+        e.file.store(nullptr, std::memory_order_relaxed); // Ordered by the release adds of the flush.
+        uint64_t n = e.allocations.load(std::memory_order_relaxed);
+        if (cachedFile && n)
+            addToGlobalSite(cachedFile, e.where.load(std::memory_order_relaxed), n,
+                            e.bytes.load(std::memory_order_relaxed));
+        e.allocations.store(0, std::memory_order_relaxed);
+        e.bytes.store(0, std::memory_order_relaxed);
+        e.where.store(where, std::memory_order_relaxed);
+        e.file.store(file, std::memory_order_release);
     }
+    bump(e.allocations, 1, false);
+    bump(e.bytes, size, false);
+}
+ 
+inline void countTelemetry(size_t size, const char* file, uintptr_t where) {
+    if (telemetryOn.load(std::memory_order_relaxed) && !insideTracker)
+        countAllocation(size, file, where);
+}
+ 
+inline void countFree() {
+    if (!telemetryOn.load(std::memory_order_relaxed) || insideTracker)
+        return;
+    ThreadTelemetry* t = tlsTelemetry;
+    if (!t)
+        t = claimTelemetry();
+    bump(t->frees, 1, t->shared);
+}
+ 
+// Periodic dump thread.
+struct TelemetryDumper {
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stop = false;
+    std::thread thread;
+ 
+    void halt() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_one();
+        if (thread.joinable())
+            thread.join();
+    }
+    ~TelemetryDumper() { halt(); }
+};
+ 
+TelemetryDumper& telemetryDumper() {
+    static TelemetryDumper dumper;
+    return dumper;
+}
+ 
+} // namespace
+ 
+void enableTelemetry(bool on) {
+    int64_t expected = 0;
+    telemetryStartNs.compare_exchange_strong(expected, nowNs());
+    telemetryOn.store(on, std::memory_order_relaxed);
+}
+ 
+TelemetrySnapshot telemetrySnapshot() {
+    TrackerScope scope;
+    TelemetrySnapshot snap{};
+    int64_t start = telemetryStartNs.load(std::memory_order_relaxed);
+    snap.seconds = start ? double(nowNs() - start) / 1e9 : 0;
+ 
+    // The global site table is read BEFORE the site caches : counts flushed from a cache after our
+    // read are then either still in that cache or not counted this time, never counted twice.
+    std::map<std::pair<const char*, uintptr_t>, uint64_t[2]> bySite;
+    for (const TelemetrySite& site : telemetrySites) {
+        if (!site.ready.load(std::memory_order_acquire))
+            continue;
+        auto& counts = bySite[{site.file, site.where}];
+        counts[0] += site.allocations.load(std::memory_order_acquire);
+        counts[1] += site.bytes.load(std::memory_order_acquire);
+    }
+    auto addBlock = [&](const ThreadTelemetry& t) {
+        for (size_t k = 0; k < kSizeClasses; ++k) {
+            snap.sizeClasses[k].allocations += t.allocations[k].load(std::memory_order_relaxed);
+            snap.sizeClasses[k].bytes += t.bytes[k].load(std::memory_order_relaxed);
+        }
+        snap.frees += t.frees.load(std::memory_order_relaxed);
+        for (const SiteCacheEntry& e : t.siteCache) {
+            const char* file = e.file.load(std::memory_order_acquire);
+            uintptr_t where = e.where.load(std::memory_order_relaxed);
+            uint64_t n = e.allocations.load(std::memory_order_relaxed);
+            uint64_t b = e.bytes.load(std::memory_order_relaxed);
+            if (!file || !n || e.file.load(std::memory_order_acquire) != file)
+                continue; // Empty, or being replaced right now.
+            auto& counts = bySite[{file, where}];
+            counts[0] += n;
+            counts[1] += b;
+        }
+    };
+    for (const ThreadTelemetry& t : telemetryBlocks)
+        addBlock(t);
+    addBlock(overflowTelemetry);
+ 
+    for (const SizeClassStats& c : snap.sizeClasses) {
+        snap.allocations += c.allocations;
+        snap.bytes += c.bytes;
+    }
+    for (auto& entry : bySite) {
+        bool untagged = entry.first.first == kUntaggedFile;
+        snap.sites.push_back({entry.first.first, untagged ? 0 : int(entry.first.second),
+                              untagged ? reinterpret_cast<const void*>(entry.first.second) : nullptr,
+                              entry.second[0], entry.second[1]});
+    }
+    std::sort(snap.sites.begin(), snap.sites.end(),
+              [](const SiteStats& a, const SiteStats& b) { return a.allocations > b.allocations; });
+    return snap;
+}
+ 
+// Snapshots are not atomic : a count can read a little low once and catch up in the next snapshot,
+// so a delta that would go negative is reported as 0 rather than wrapping around.
+inline uint64_t minusClamped(uint64_t a, uint64_t b) {
+    return a > b ? a - b : 0;
+}
+ 
+void printTelemetry(std::ostream& out, const TelemetrySnapshot& now, const TelemetrySnapshot* previous,
+                    size_t topSites) {
+    TrackerScope scope;
+    double seconds = previous ? now.seconds - previous->seconds : now.seconds;
+    uint64_t allocations = minusClamped(now.allocations, previous ? previous->allocations : 0);
+    uint64_t bytes = minusClamped(now.bytes, previous ? previous->bytes : 0);
+    char line[160];
+    snprintf(line, sizeof line, "[%.3f s] %llu allocations (%.0f/s), %.1f MB (%.1f MB/s), %llu frees\n",
+             now.seconds, (unsigned long long)now.allocations, seconds > 0 ? allocations / seconds : 0.0,
+             now.bytes / 1e6, seconds > 0 ? bytes / seconds / 1e6 : 0.0, (unsigned long long)now.frees);
+    out << line;
+    for (size_t k = 0; k < kSizeClasses; ++k) {
+        const SizeClassStats& c = now.sizeClasses[k];
+        uint64_t n = minusClamped(c.allocations, previous ? previous->sizeClasses[k].allocations : 0);
+        if (!c.allocations)
+            continue;
+        unsigned long long lo = k ? 1ull << (k - 1) : 0, hi = k ? (1ull << k) - 1 : 0;
+        snprintf(line, sizeof line, "  %9llu - %-9llu %12llu allocs %5.1f%%  %10.1f MB %5.1f%%  %10.0f/s\n", lo, hi,
+                 (unsigned long long)c.allocations, 100.0 * c.allocations / now.allocations, c.bytes / 1e6,
+                 now.bytes ? 100.0 * c.bytes / now.bytes : 0.0, seconds > 0 ? n / seconds : 0.0);
+        out << line;
+    }
+
+    // Sites : totals, plus the count and rate since `previous`. Busiest over that interval first.
+    struct SiteDelta {
+        const SiteStats* site;
+        uint64_t allocations, bytes;
+    };
+    std::map<std::tuple<const char*, int, const void*>, const SiteStats*> before;
+    if (previous)
+        for (const SiteStats& site : previous->sites)
+            before[{site.file, site.line, site.caller}] = &site;
+    std::vector<SiteDelta> deltas;
+    for (const SiteStats& site : now.sites) {
+        auto it = before.find({site.file, site.line, site.caller});
+        const SiteStats* old = it == before.end() ? nullptr : it->second;
+        deltas.push_back({&site, minusClamped(site.allocations, old ? old->allocations : 0),
+                          minusClamped(site.bytes, old ? old->bytes : 0)});
+    }
+    std::stable_sort(deltas.begin(), deltas.end(),
+                     [](const SiteDelta& a, const SiteDelta& b) { return a.allocations > b.allocations; });
+    for (size_t i = 0; i < deltas.size() && i < topSites; ++i) {
+        const SiteDelta& d = deltas[i];
+        out << "  " << d.site->file << ":" << d.site->line;
+        if (d.site->caller)
+            out << " @ " << d.site->caller;
+        snprintf(line, sizeof line, "  %llu allocs, %llu bytes | %llu allocs (%.0f/s), %.1f MB/s\n",
+                 (unsigned long long)d.site->allocations, (unsigned long long)d.site->bytes,
+                 (unsigned long long)d.allocations, seconds > 0 ? d.allocations / seconds : 0.0,
+                 seconds > 0 ? d.bytes / seconds / 1e6 : 0.0);
+        out << line;
+    }
+}
+ 
+void startTelemetryDump(const std::string& path, std::chrono::milliseconds interval) {
+    stopTelemetryDump();
+    TrackerScope scope;
+    TelemetryDumper& dumper = telemetryDumper();
+    {
+        std::lock_guard<std::mutex> lock(dumper.mutex);
+        dumper.stop = false;
+    }
+    dumper.thread = std::thread([&dumper, path, interval] {
+        insideTracker = true; // Nothing this thread allocates is counted or recorded.
+        std::ofstream file;
+        if (!path.empty())
+            file.open(path, std::ios::app);
+        std::ostream& out = path.empty() ? std::cerr : file;
+        TelemetrySnapshot previous = telemetrySnapshot();
+        std::unique_lock<std::mutex> lock(dumper.mutex);
+        while (!dumper.wake.wait_for(lock, interval, [&dumper] { return dumper.stop; })) {
+            lock.unlock();
+            TelemetrySnapshot now = telemetrySnapshot();
+            printTelemetry(out, now, &previous, 5);
+            out.flush();
+            previous = std::move(now);
+            lock.lock();
+        }
+    });
+}
+ 
+void stopTelemetryDump() {
+    TrackerScope scope;
+    telemetryDumper().halt();
 }
  
 // Overloaded new operators
 void* operator new(size_t size, const char* file, int line) {
     void* ptr = malloc(size);
     if (!ptr) throw std::bad_alloc();
-    logAllocation(ptr, size, file, line);
+    countTelemetry(size, file, uintptr_t(line));
+    recordAllocation(ptr, size, file, line, __builtin_return_address(0));
     return ptr;
 }
  
 void* operator new[](size_t size, const char* file, int line) {
     void* ptr = malloc(size);
     if (!ptr) throw std::bad_alloc();
-    logAllocation(ptr, size, file, line);
+    countTelemetry(size, file, uintptr_t(line));
+    recordAllocation(ptr, size, file, line, __builtin_return_address(0));
     return ptr;
 }
  
 // Overloaded delete operators
+// Out of line : inlined into the STL code of this file, GCC would pair free() with operator new
+// and warn (-Wmismatched-new-delete), but here operator new is malloc.
+__attribute__((noinline)) static void releaseBlock(void* ptr) noexcept {
+    countFree();
+    logDeallocation(ptr);
+    free(ptr);
+}
+ 
 void operator delete(void* ptr) noexcept {
     if (ptr) {
-        logDeallocation(ptr);
-        free(ptr);
+        releaseBlock(ptr);
     }
 }
  
 void operator delete[](void* ptr) noexcept {
     if (ptr) {
-        logDeallocation(ptr);
-        free(ptr);
+        releaseBlock(ptr);
+    }
+}
+ 
+// Global mode : every other global new/delete overload is replaced too, so the whole program
+// allocates through here (malloc / posix_memalign) and every delete ends in free(). Pointers
+// that were never recorded are turned away by the shard's counting filter without a lookup.
+namespace {
+ 
+void* allocateOrNull(size_t size, size_t alignment) {
+    if (size == 0)
+        size = 1; // new must return a unique pointer even for 0 bytes.
+    if (alignment <= alignof(std::max_align_t))
+        return malloc(size);
+    void* ptr = nullptr;
+    return posix_memalign(&ptr, alignment, size) == 0 ? ptr : nullptr;
+}
+ 
+// Standard behavior : retry through the new_handler, throw when there is none.
+void* allocateOrThrow(size_t size, size_t alignment) {
+    for (;;) {
+        if (void* ptr = allocateOrNull(size, alignment))
+            return ptr;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+ 
+void* allocateNoThrow(size_t size, size_t alignment) noexcept {
+    try {
+        return allocateOrThrow(size, alignment);
     }
+    catch (...) {
+        return nullptr;
+    }
+}
+ 
+inline void* trackGlobal(void* ptr, size_t size, void* caller) {
+    if (ptr)
+        countTelemetry(size, kUntaggedFile, reinterpret_cast<uintptr_t>(caller));
+    if (ptr && globalTracking.load(std::memory_order_relaxed) && !insideTracker)
+        recordAllocation(ptr, size, kUntaggedFile, 0, caller);
+    return ptr;
+}
+ 
+} // namespace
+ 
+void* operator new(size_t size) {
+    return trackGlobal(allocateOrThrow(size, 0), size, __builtin_return_address(0));
+}
+ 
+void* operator new[](size_t size) {
+    return trackGlobal(allocateOrThrow(size, 0), size, __builtin_return_address(0));
+}
+ 
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return trackGlobal(allocateNoThrow(size, 0), size, __builtin_return_address(0));
+}
+ 
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return trackGlobal(allocateNoThrow(size, 0), size, __builtin_return_address(0));
+}
+ 
+void* operator new(size_t size, std::align_val_t alignment) {
+    return trackGlobal(allocateOrThrow(size, size_t(alignment)), size, __builtin_return_address(0));
+}
+ 
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return trackGlobal(allocateOrThrow(size, size_t(alignment)), size, __builtin_return_address(0));
+}
+ 
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return trackGlobal(allocateNoThrow(size, size_t(alignment)), size, __builtin_return_address(0));
+}
+ 
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return trackGlobal(allocateNoThrow(size, size_t(alignment)), size, __builtin_return_address(0));
+}
+ 
+// Sized, aligned and nothrow deletes : the size and alignment are not needed, free() knows.
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { operator delete[](ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { operator delete[](ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { operator delete[](ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { operator delete[](ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { operator delete[](ptr); }
+ 
+// Called if a constructor throws after new(__FILE__, __LINE__).
+void operator delete(void* ptr, const char*, int) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, const char*, int) noexcept { operator delete[](ptr); }
+ 
+// new(__FILE__, __LINE__) on an over-aligned type : without these the compiler would fall back to
+// the unaligned tagged overloads above and the alignment would be lost.
+void* operator new(size_t size, std::align_val_t alignment, const char* file, int line) {
+    void* ptr = allocateOrThrow(size, size_t(alignment));
+    countTelemetry(size, file, uintptr_t(line));
+    recordAllocation(ptr, size, file, line, __builtin_return_address(0));
+    return ptr;
+}
+ 
+void* operator new[](size_t size, std::align_val_t alignment, const char* file, int line) {
+    void* ptr = allocateOrThrow(size, size_t(alignment));
+    countTelemetry(size, file, uintptr_t(line));
+    recordAllocation(ptr, size, file, line, __builtin_return_address(0));
+    return ptr;
 }
+ 
+void operator delete(void* ptr, std::align_val_t, const char*, int) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const char*, int) noexcept { operator delete[](ptr); }
@@ -3,16 +3,23 @@
 #define MEM_TRACKER_H
  
 #include <iostream>
-#include <unordered_map>
+#include <cstddef>
+#include <new>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <chrono>
  
 struct Allocation {
     size_t size;//Stores the size of allocated memory.
     const char* file;//Stores the filename where allocation happened.
     int line;//tores the line number where allocation happened.
+    double weight = 1;//How many allocations this record stands for (above 1 in sampling mode).
+    int site = -1;//Call site index in the heap profile, -1 when profiling is off.
 };
  
-// Global allocation map declaration
-extern std::unordered_map<void*, Allocation> allocMap;
+// Live allocations are kept in a sharded open-addressing table (see mem_tracker.cpp) :
+// safe to use from many threads, and recording an allocation never allocates.
  
 //Adds a new memory allocation record.
 void logAllocation(void* ptr, size_t size, const char* file, int line);
@@ -21,9 +28,88 @@ void logAllocation(void* ptr, size_t size, const char* file, int line);
 //Removes a record when memory is freed
 void logDeallocation(void* ptr);
  
+//Number of allocations currently recorded.
+size_t trackedAllocationCount();
+ 
+// Global mode : mem_tracker.cpp replaces every global operator new/delete (plain, array, nothrow,
+// aligned and sized). With setGlobalTracking(true), allocations that don't go through the
+// new(__FILE__, __LINE__) macro (STL containers, make_shared, libraries) are recorded too, as
+// "(untagged new)" with the caller's address. The tracker's own allocations are never recorded.
+void setGlobalTracking(bool on);
+ 
+// Full    : every allocation is recorded (default, exact leak report).
+// Sampled : on average one allocation per `sampleEveryBytes` allocated bytes is recorded. The others
+//           only cost a decrement and a compare of a thread_local counter. Reports are estimates,
+//           scaled by each sample's weight. Other threads switch mode at their next sample.
+enum class TrackingMode { Full, Sampled };
+void setTrackingMode(TrackingMode mode, size_t sampleEveryBytes = 512 * 1024);
+ 
+struct HeapEstimate {
+    double bytes;       // Estimated live bytes.
+    double allocations; // Estimated live allocations.
+    size_t records;     // Entries actually in the table.
+};
+ 
+//Live heap allocated through the tracker (exact in Full mode).
+HeapEstimate liveHeapEstimate();
+ 
 //Checks for leaks and prints detected ones.
 void checkLeaks();
  
+// Heap profile : recorded allocations are also aggregated per call site (file:line, plus the
+// caller's stack when stackDepth > 0) : live bytes and count, total allocated bytes and count, and
+// a power-of-two size-class histogram. Off by default, only applies to allocations made after it
+// is turned on. In sampling mode every number is an estimate (scaled by the sample weights).
+void enableHeapProfile(bool on, int stackDepth = 0);
+ 
+//Top call sites by live bytes, one line each (instead of one line per leaked pointer).
+void printHeapProfile(std::ostream& out, size_t topSites = 20);
+ 
+enum class HeapMetric { LiveBytes, LiveCount, AllocatedBytes, AllocatedCount };
+ 
+//Folded stacks ("frame;frame;file:line value") for flamegraph.pl / speedscope. Link with -rdynamic
+//to get function names.
+void writeFoldedStacks(std::ostream& out, HeapMetric metric = HeapMetric::LiveBytes);
+ 
+//Legacy pprof heap profile text format (pprof <binary> <file>), with /proc/self/maps appended.
+void writePprofHeapProfile(std::ostream& out);
+ 
+// Telemetry : count of every operator new (tagged or not, tracked or not) per power-of-two size
+// class and per call site, in lock-free thread-local counters (a few ns per allocation).
+void enableTelemetry(bool on);
+ 
+struct SizeClassStats {
+    uint64_t allocations;
+    uint64_t bytes;
+};
+ 
+struct SiteStats {
+    const char* file;
+    int line;           // 0 for untagged allocations,
+    const void* caller; // which are told apart by the caller's address.
+    uint64_t allocations;
+    uint64_t bytes;
+};
+ 
+struct TelemetrySnapshot {
+    double seconds;                // Since telemetry was first enabled.
+    uint64_t allocations, bytes, frees;
+    SizeClassStats sizeClasses[32]; // Class k : sizes in [2^(k-1), 2^k), class 0 : empty allocations.
+    std::vector<SiteStats> sites;  // Most allocations first.
+};
+ 
+//Totals so far. Taken while other threads allocate, it can be off by a few counts.
+TelemetrySnapshot telemetrySnapshot();
+ 
+//Rates (totals, size classes and call sites) are per second since `previous` if given, else
+//since telemetry was enabled. Sites are listed busiest over that interval first.
+void printTelemetry(std::ostream& out, const TelemetrySnapshot& now, const TelemetrySnapshot* previous = nullptr,
+                    size_t topSites = 10);
+ 
+//Background thread printing the telemetry every `interval` (to stderr when path is empty).
+void startTelemetryDump(const std::string& path, std::chrono::milliseconds interval);
+void stopTelemetryDump();
+ 
 // Placement new overloads
 void* operator new(size_t size, const char* file, int line);
 void* operator new[](size_t size, const char* file, int line);
@@ -32,4 +118,14 @@ void* operator new[](size_t size, const char* file, int line);
 void operator delete(void* ptr) noexcept;
 void operator delete[](void* ptr) noexcept;
  
+// Matching placement deletes, called if a constructor throws after new(__FILE__, __LINE__)
+void operator delete(void* ptr, const char* file, int line) noexcept;
+void operator delete[](void* ptr, const char* file, int line) noexcept;
+ 
+// Same for over-aligned types (alignas above the default new alignment)
+void* operator new(size_t size, std::align_val_t alignment, const char* file, int line);
+void* operator new[](size_t size, std::align_val_t alignment, const char* file, int line);
+void operator delete(void* ptr, std::align_val_t alignment, const char* file, int line) noexcept;
+void operator delete[](void* ptr, std::align_val_t alignment, const char* file, int line) noexcept;
+ 
 #endif // MEM_TRACKER_H
@@ -0,0 +1,85 @@
+//****** Allocation rate and size-class telemetry ******//
+
+//NOTES :
+//1. Profiles (checkLeaks, printHeapProfile) answer "what is live". Telemetry answers "how fast and
+//   how big" : allocations per second, per power-of-two size class and per call site.
+//2. enableTelemetry(true) counts every operator new, tagged or not, whatever the tracking mode.
+//   Counters are thread-local and single-writer : a load + store, no lock, no shared cache line.
+//3. telemetrySnapshot() sums all threads, printTelemetry() prints totals, rates and top sites.
+//   startTelemetryDump(path, interval) does it periodically from a background thread.
+//4. main() measures the cost per allocation with telemetry off and on, then runs a mixed workload
+//   with a dump every 100 ms.
+
+//Compile : g++ -std=c++17 -O2 -pthread telemetry_demo.cpp mem_tracker.cpp
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <string>
+#include "mem_tracker.h"
+
+const int kPairs = 200000;
+
+void smallPairs() {
+    for (int i = 0; i < kPairs; ++i) {
+        int* p = new (__FILE__, __LINE__) int(i);
+        delete p;
+    }
+}
+
+double nsPerPair(int threads) {
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t)
+        pool.emplace_back(smallPairs);
+    for (auto& t : pool)
+        t.join();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    return ns / (double(kPairs) * threads);
+}
+
+// Sizes from a few bytes to a few KB, through tagged new and through std::string (untagged).
+void mixedWorkload(int seed) {
+    auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(350);
+    unsigned x = seed;
+    while (std::chrono::steady_clock::now() < until) {
+        for (int i = 0; i < 1000; ++i) {
+            x = x * 1664525 + 1013904223;
+            size_t size = size_t(8) << (x >> 28) % 10; // 8 B .. 4 KB
+            char* buffer = new (__FILE__, __LINE__) char[size];
+            buffer[0] = 0;
+            delete[] buffer;
+            std::string s(40 + x % 64, 'x');
+        }
+    }
+}
+
+int main() {
+    setTrackingMode(TrackingMode::Sampled); // Keep the table out of the way : only telemetry changes.
+
+    std::cout << "ns per new/delete pair\nthreads   telemetry off   telemetry on   overhead\n";
+    for (int threads : { 1, 4 }) {
+        enableTelemetry(false);
+        double off = nsPerPair(threads);
+        enableTelemetry(true);
+        double on = nsPerPair(threads);
+        printf("%7d   %13.1f   %12.1f   %8.1f\n", threads, off, on, on - off);
+    }
+
+    std::cout << "\nMixed workload, dump every 100 ms\n";
+    TelemetrySnapshot before = telemetrySnapshot();
+    startTelemetryDump("", std::chrono::milliseconds(100));
+    std::vector<std::thread> pool;
+    for (int t = 0; t < 4; ++t)
+        pool.emplace_back(mixedWorkload, t + 1);
+    for (auto& t : pool)
+        t.join();
+    stopTelemetryDump();
+
+    std::cout << "\nWhole workload\n";
+    TelemetrySnapshot after = telemetrySnapshot();
+    printTelemetry(std::cout, after, &before, 5);
+    std::cout << "allocations " << after.allocations << ", frees " << after.frees << "\n";
+    return 0;
+}
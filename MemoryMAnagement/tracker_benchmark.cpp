@@ -0,0 +1,139 @@
+//****** mem_tracker overhead with many threads ******//
+
+//NOTES :
+//1. Every thread does N pairs of `new int` / `delete` through the tracker (new(__FILE__, __LINE__)).
+//2. Compared with :
+//   a. malloc/free alone       -> the cost of the allocator itself.
+//   b. mutex + unordered_map   -> the obvious thread-safe tracker : one global lock and one map
+//                                 node per allocation.
+//   Overhead per pair = (tracker - malloc/free).
+//3. The tracker runs twice : Full mode, and Sampled mode (one sample per 512 KB on average).
+//4. Sampling accuracy : keep 100k allocations of mixed sizes alive and compare the live heap
+//   estimate with the real numbers.
+//5. At the end no allocation may be left in the table.
+
+//Compile : g++ -std=c++17 -O2 -pthread tracker_benchmark.cpp mem_tracker.cpp
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <chrono>
+#include <cstdlib>
+#include "mem_tracker.h"
+
+// Map nodes from malloc, so the reference tracker doesn't go through the tracked delete.
+template<class T>
+struct MallocAllocator {
+    using value_type = T;
+    MallocAllocator() = default;
+    template<class U> MallocAllocator(const MallocAllocator<U>&) {}
+    T* allocate(size_t n) { return static_cast<T*>(malloc(n * sizeof(T))); }
+    void deallocate(T* p, size_t) { free(p); }
+    template<class U> bool operator==(const MallocAllocator<U>&) const { return true; }
+    template<class U> bool operator!=(const MallocAllocator<U>&) const { return false; }
+};
+
+std::mutex globalMutex;
+std::unordered_map<void*, Allocation, std::hash<void*>, std::equal_to<void*>,
+                   MallocAllocator<std::pair<void* const, Allocation>>> globalMap;
+
+const int kPairs = 200000;
+const int kLive = 64; // Each thread keeps a few allocations alive, like a real program.
+
+void mallocOnly() {
+    void* live[kLive] = {};
+    for (int i = 0; i < kPairs; ++i) {
+        void*& slot = live[i % kLive];
+        free(slot);
+        slot = malloc(sizeof(int));
+    }
+    for (void* p : live)
+        free(p);
+}
+
+void trackedNew() {
+    int* live[kLive] = {};
+    for (int i = 0; i < kPairs; ++i) {
+        int*& slot = live[i % kLive];
+        delete slot;
+        slot = new (__FILE__, __LINE__) int(i);
+    }
+    for (int* p : live)
+        delete p;
+}
+
+void mutexMap() {
+    void* live[kLive] = {};
+    for (int i = 0; i < kPairs; ++i) {
+        void*& slot = live[i % kLive];
+        if (slot) {
+            std::lock_guard<std::mutex> lock(globalMutex);
+            globalMap.erase(slot);
+        }
+        free(slot);
+        slot = malloc(sizeof(int));
+        std::lock_guard<std::mutex> lock(globalMutex);
+        globalMap[slot] = { sizeof(int), __FILE__, __LINE__ };
+    }
+    for (void* p : live) {
+        {
+            std::lock_guard<std::mutex> lock(globalMutex);
+            globalMap.erase(p);
+        }
+        free(p);
+    }
+}
+
+double nsPerPair(void (*fn)(), int threads) {
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t)
+        pool.emplace_back(fn);
+    for (auto& t : pool)
+        t.join();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    return ns / (double(kPairs) * threads);
+}
+
+void samplingAccuracy(size_t sampleEveryBytes) {
+    setTrackingMode(TrackingMode::Sampled, sampleEveryBytes);
+    const int count = 100000;
+    std::vector<char*> live(count);
+    double bytes = 0;
+    for (int i = 0; i < count; ++i) {
+        size_t size = 16 + (i * 7919) % 4096; // 16 B .. 4 KB
+        live[i] = new (__FILE__, __LINE__) char[size];
+        bytes += size;
+    }
+    HeapEstimate e = liveHeapEstimate();
+    printf("sample every %7zu B : %6zu records, estimated %6.1f MB in %7.0f allocations "
+           "(real %6.1f MB in %d, error %+.1f%%)\n", sampleEveryBytes, e.records, e.bytes / 1e6,
+           e.allocations, bytes / 1e6, count, 100 * (e.bytes - bytes) / bytes);
+    for (char* p : live)
+        delete[] p;
+    setTrackingMode(TrackingMode::Full);
+}
+ 
+int main() {
+    std::cout << "ns per new/delete pair (wall time / total pairs)\n";
+    std::cout << "threads   malloc/free   tracker   sampled   mutex+map   tracker overhead   sampled overhead\n";
+    for (int threads : { 1, 2, 4, 8 }) {
+        double base = nsPerPair(mallocOnly, threads);
+        setTrackingMode(TrackingMode::Full);
+        double tracked = nsPerPair(trackedNew, threads);
+        setTrackingMode(TrackingMode::Sampled);
+        double sampled = nsPerPair(trackedNew, threads);
+        setTrackingMode(TrackingMode::Full);
+        double locked = nsPerPair(mutexMap, threads);
+        printf("%7d   %11.1f   %7.1f   %7.1f   %9.1f   %16.1f   %16.1f\n", threads, base, tracked, sampled,
+               locked, tracked - base, sampled - base);
+    }
+ 
+    std::cout << "\nLive heap estimate in sampling mode\n";
+    for (size_t every : { 4096, 65536, 512 * 1024 })
+        samplingAccuracy(every);
+    std::cout << "Allocations left in the table : " << trackedAllocationCount() << "\n";
+    return 0;
+}
@@ -0,0 +1,334 @@
+//****** Thread Pool with CPU affinity and sticky tasks ******//
+
+//NOTES :
+//1. Workers of ThreadPool.cpp can be moved by the OS scheduler to any core at any time. A task that
+//   works on cache-hot data then finds a cold L1/L2 on the new core.
+//2. AffinityPolicy pins every worker to one CPU with pthread_setaffinity_np (Linux only) :
+//   a. None     -> no pinning (old behaviour).
+//   b. Compact  -> fills hyperthread siblings of a core, then the next core, one socket first.
+//   c. Scatter  -> spreads workers over sockets and physical cores first, siblings last.
+//   d. Explicit -> the CPU list given by the caller.
+//   Compact and Scatter read the topology from /sys/devices/system/cpu/cpuN/topology and only use
+//   CPUs allowed by the process mask (taskset, cgroups), wrapping around if there are more workers
+//   than CPUs.
+//   Errors are not silent : an Explicit policy with an empty list throws std::invalid_argument, a
+//   CPU the thread can't be pinned to throws std::system_error from the constructor.
+//3. enqueue_sticky(key, task) : tasks with the same key always go to the same worker, so data
+//   that belongs to that key stays in that core's cache. Plain enqueue still uses the shared queue.
+//4. main() runs a memory-bound task (each key owns a buffer that fits in L2) with and without
+//   sticky routing and prints time and, when perf events are allowed, hardware cache misses.
+//   Outside Linux the pool still works, pinning is just skipped.
+
+//Compile : g++ -std=c++17 -O2 -pthread AffinityThreadPool.cpp
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <queue>
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <system_error>
+
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+enum class AffinityPolicy { None, Compact, Scatter, Explicit };
+
+// CPUs this process may run on, in id order.
+std::vector<int> allowedCpus() {
+   std::vector<int> cpus;
+#ifdef __linux__
+   cpu_set_t set;
+   CPU_ZERO(&set);
+   if (sched_getaffinity(0, sizeof(set), &set) == 0)
+       for (int c = 0; c < CPU_SETSIZE; ++c)
+           if (CPU_ISSET(c, &set))
+               cpus.push_back(c);
+#endif
+   return cpus;
+}
+
+int readTopology(int cpu, const char* field) {
+   std::ifstream in("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/" + field);
+   int value = 0;
+   in >> value;
+   return value;
+}
+
+// Order in which workers are placed on CPUs for a policy.
+std::vector<int> placementOrder(AffinityPolicy policy, const std::vector<int>& explicitCpus) {
+   if (policy == AffinityPolicy::Explicit) {
+       if (explicitCpus.empty())
+           throw std::invalid_argument("AffinityPolicy::Explicit needs at least one CPU");
+       return explicitCpus;
+   }
+   std::vector<int> cpus = allowedCpus();
+
+   // Compact : (socket, core, sibling)  -> every thread of a core, then the next core.
+   // Scatter : (sibling, core, socket)  -> 1st thread of every core on every socket, then the 2nd...
+   std::map<std::pair<int, int>, int> seenPerCore; // (socket, core) -> threads placed so far
+   std::vector<std::tuple<int, int, int, int>> keyed;
+   for (int c : cpus) {
+       int socket = readTopology(c, "physical_package_id");
+       int core = readTopology(c, "core_id");
+       int sibling = seenPerCore[{ socket, core }]++;
+       if (policy == AffinityPolicy::Compact)
+           keyed.emplace_back(socket, core, sibling, c);
+       else
+           keyed.emplace_back(sibling, core, socket, c);
+   }
+   std::sort(keyed.begin(), keyed.end());
+   cpus.clear();
+   for (auto& k : keyed)
+       cpus.push_back(std::get<3>(k));
+   return cpus;
+}
+
+// 0 on success, else the error number. Outside Linux pinning is skipped (and not an error).
+int pinThread(std::thread& thread, int cpu) {
+#ifdef __linux__
+   if (cpu < 0 || cpu >= CPU_SETSIZE)
+       return EINVAL;
+   cpu_set_t set;
+   CPU_ZERO(&set);
+   CPU_SET(cpu, &set);
+   return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+   (void)thread;
+   (void)cpu;
+   return 0;
+#endif
+}
+
+class ThreadPool {
+public:
+   ThreadPool(size_t numThreads, AffinityPolicy policy = AffinityPolicy::None,
+              const std::vector<int>& explicitCpus = {})
+       : stop(false), locals(numThreads) {
+       std::vector<int> order = policy == AffinityPolicy::None ? std::vector<int>()
+                                                              : placementOrder(policy, explicitCpus);
+       for (size_t i = 0; i < numThreads; ++i)
+           workers.emplace_back([this, i] { workerLoop(i); });
+
+       // Pinned from here, so a failure can be reported to the caller.
+       for (size_t i = 0; i < numThreads && !order.empty(); ++i) {
+           int cpu = order[i % order.size()];
+           int error = pinThread(workers[i], cpu);
+           if (error != 0) {
+               shutdown();
+               throw std::system_error(error, std::generic_category(),
+                                       "cannot pin worker " + std::to_string(i) + " to CPU " + std::to_string(cpu));
+           }
+#ifdef __linux__
+           std::lock_guard<std::mutex> lock(queueMutex);
+           locals[i].cpu = cpu;
+#endif
+       }
+   }
+
+   template<class F>
+   void enqueue(F&& task) {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       tasks.emplace(std::forward<F>(task));
+       size_t wake = pickIdleLocked();
+       lock.unlock();
+       if (wake < locals.size())
+           locals[wake].cv.notify_one();
+   }
+
+   // Every task with the same key runs on the same worker (and so on the same pinned CPU).
+   template<class F>
+   void enqueue_sticky(size_t key, F&& task) {
+       size_t w = key % locals.size();
+       std::unique_lock<std::mutex> lock(queueMutex);
+       locals[w].tasks.emplace(std::forward<F>(task));
+       lock.unlock();
+       locals[w].cv.notify_one();
+   }
+
+   // CPU each worker was pinned to, -1 if it was not pinned.
+   std::vector<int> pinned_cpus() {
+       std::lock_guard<std::mutex> lock(queueMutex);
+       std::vector<int> cpus;
+       for (auto& l : locals)
+           cpus.push_back(l.cpu);
+       return cpus;
+   }
+
+   ~ThreadPool() {
+       shutdown();
+   }
+
+private:
+   void shutdown() {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       stop = true;
+       lock.unlock();
+       for (auto& l : locals)
+           l.cv.notify_all();
+       for (std::thread& worker : workers)
+           worker.join();
+   }
+
+   struct Local {
+       std::queue<std::function<void()>> tasks; // Sticky tasks for this worker only.
+       std::condition_variable cv;
+       bool idle = false;
+       int cpu = -1;
+   };
+
+   // Called with queueMutex held : an idle worker to wake for a shared task, or locals.size().
+   size_t pickIdleLocked() {
+       for (size_t i = 0; i < locals.size(); ++i) {
+           if (locals[i].idle) {
+               locals[i].idle = false;
+               return i;
+           }
+       }
+       return locals.size();
+   }
+
+   void workerLoop(size_t index) {
+       Local& me = locals[index];
+       std::unique_lock<std::mutex> lock(queueMutex);
+       for (;;) {
+           me.idle = true;
+           me.cv.wait(lock, [this, &me] { return stop || !me.tasks.empty() || !tasks.empty(); });
+           me.idle = false;
+           if (stop && me.tasks.empty() && tasks.empty())
+               return;
+           // Own sticky work first, it is the work whose data is in our cache.
+           auto& from = !me.tasks.empty() ? me.tasks : tasks;
+           auto task = std::move(from.front());
+           from.pop();
+           lock.unlock();
+           task();
+           lock.lock();
+       }
+   }
+
+   std::vector<std::thread> workers;
+   std::queue<std::function<void()>> tasks;
+
+   std::mutex queueMutex;
+   bool stop;
+   std::vector<Local> locals;
+};
+
+// Hardware cache misses of this thread and of every thread it creates afterwards.
+class CacheMissCounter {
+public:
+   CacheMissCounter() {
+#ifdef __linux__
+       perf_event_attr attr;
+       std::memset(&attr, 0, sizeof(attr));
+       attr.size = sizeof(attr);
+       attr.type = PERF_TYPE_HARDWARE;
+       attr.config = PERF_COUNT_HW_CACHE_MISSES;
+       attr.disabled = 1;
+       attr.inherit = 1; // Count the pool's workers too.
+       attr.exclude_kernel = 1;
+       attr.exclude_hv = 1;
+       fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+       if (fd >= 0) {
+           ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+           ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+       }
+#endif
+   }
+
+   // Read after the workers have been joined, inherited counts are added when they exit.
+   long long read() const {
+#ifdef __linux__
+       long long value = 0;
+       if (fd >= 0 && ::read(fd, &value, sizeof(value)) == sizeof(value))
+           return value;
+#endif
+       return -1;
+   }
+
+   ~CacheMissCounter() {
+#ifdef __linux__
+       if (fd >= 0)
+           close(fd);
+#endif
+   }
+
+private:
+   int fd = -1;
+};
+
+// Each key owns a 128 KB buffer, every task walks its key's buffer a few times.
+void memoryBound(const char* name, AffinityPolicy policy, bool sticky) {
+   const size_t workers = 4, keys = 4, tasksPerKey = 400, bufferInts = 32 * 1024;
+   std::vector<std::vector<int>> buffers(keys, std::vector<int>(bufferInts, 1));
+   std::atomic<long long> checksum(0);
+
+   CacheMissCounter misses;
+   auto t0 = std::chrono::steady_clock::now();
+   {
+       ThreadPool pool(workers, policy);
+       for (size_t t = 0; t < tasksPerKey; ++t) {
+           for (size_t k = 0; k < keys; ++k) {
+               auto work = [&buffers, &checksum, k] {
+                   // Read only : without sticky routing two workers may walk the same buffer.
+                   const std::vector<int>& buf = buffers[k];
+                   long long sum = 0;
+                   for (size_t pass = 0; pass < 4; ++pass)
+                       for (size_t i = pass; i < buf.size(); i += 4)
+                           sum += buf[i];
+                   checksum.fetch_add(sum, std::memory_order_relaxed);
+               };
+               if (sticky)
+                   pool.enqueue_sticky(k, work);
+               else
+                   pool.enqueue(work);
+           }
+       }
+   }
+   auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+   long long m = misses.read();
+   if (m >= 0)
+       printf("%-28s %6lld ms   cache misses %12lld\n", name, static_cast<long long>(ms), m);
+   else
+       printf("%-28s %6lld ms   cache misses n/a (perf events not permitted)\n", name, static_cast<long long>(ms));
+}
+
+int main() {
+   {
+       for (auto policy : { AffinityPolicy::Compact, AffinityPolicy::Scatter }) {
+           ThreadPool pool(4, policy);
+           std::cout << (policy == AffinityPolicy::Compact ? "Compact" : "Scatter") << " placement :";
+           for (int cpu : pool.pinned_cpus())
+               std::cout << " " << cpu;
+           std::cout << "\n";
+       }
+   }
+   try {
+       ThreadPool pool(2, AffinityPolicy::Explicit, { 1 << 20 }); // No such CPU.
+   }
+   catch (const std::exception& e) {
+       std::cout << "Explicit with a bad CPU : " << e.what() << "\n\n";
+   }
+
+   memoryBound("unpinned, shared queue", AffinityPolicy::None, false);
+   memoryBound("compact pinned, shared queue", AffinityPolicy::Compact, false);
+   memoryBound("compact pinned, sticky keys", AffinityPolicy::Compact, true);
+   return 0;
+}
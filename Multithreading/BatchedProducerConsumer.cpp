@@ -0,0 +1,235 @@
+//****** Batched Producer/Consumer ******//
+
+//NOTES :
+//1. In ProducerConsumerUsingMutex.cpp every single int costs a lock, an unlock and a notify on both
+//   sides. And consumer() takes buffer.back(), so it is a stack (LIFO), not a queue.
+//2. BatchQueue<T> is the same bounded buffer (mutex + two condition_variables + deque) with batch APIs :
+//   a. push_n(first, last)   -> moves the items in under ONE lock (as many as fit, then waits for
+//                               room for the rest). One notify per batch, not per item.
+//   b. pop_up_to(n, out)     -> waits until something is there, then moves out up to n items from
+//                               the FRONT under one lock. Returns how many, 0 means closed and empty.
+//                               n == 0 is taken as 1, so 0 never means anything but closed.
+//   c. close()               -> consumers drain what is left and then get 0.
+//   Items always come out in the order they went in (FIFO).
+//3. Adaptive batch size (Batcher) :
+//   a. A producer that collects 64 items before pushing is fast, but under light load the first
+//      item waits for 63 more : latency goes up for nothing.
+//   b. Light load : if add() comes after a gap (> gapThreshold since the previous add) the batch
+//      goes back to 1 and the item is handed over at once.
+//   c. Full load (adds back to back) : every flush doubles the batch, up to the max, and never
+//      below half the queue depth (a deep queue means the consumer is behind, so items would
+//      wait in the queue anyway and batching costs no latency).
+//   d. The consumer side never waits for a full batch, it takes whatever is there (up to n), so it
+//      adds no latency. A producer that stops for a long time should call flush().
+//4. main() compares single item / fixed batch / adaptive batch : throughput under full load and
+//   latency under light load, all with the same queue capacity.
+
+//Compile : g++ -std=c++17 -O2 -pthread BatchedProducerConsumer.cpp
+
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <condition_variable>
+#include <chrono>
+
+template<class T>
+class BatchQueue {
+public:
+   explicit BatchQueue(size_t maxBufferSize) : maxBufferSize(maxBufferSize) {}
+
+   void push(T value) { push_n(&value, &value + 1); }
+
+   // Blocks until every item is in the queue. Returns false if the queue was closed.
+   template<class It>
+   bool push_n(It first, It last) {
+       while (first != last) {
+           std::unique_lock<std::mutex> locker(mu);
+           notFull.wait(locker, [this] { return closed || buffer.size() < maxBufferSize; });
+           if (closed)
+               return false;
+           size_t room = maxBufferSize - buffer.size();
+           for (; first != last && room; ++first, --room)
+               buffer.push_back(std::move(*first));
+           depth.store(buffer.size(), std::memory_order_relaxed);
+           ++syncs;
+           locker.unlock();
+           notEmpty.notify_one();
+       }
+       return true;
+   }
+
+   // Appends up to n items to out, oldest first. Returns 0 only when closed and drained.
+   size_t pop_up_to(size_t n, std::vector<T>& out) {
+       if (n == 0)
+           n = 1; // Otherwise 0 items would come back and the caller would think the queue is closed.
+       std::unique_lock<std::mutex> locker(mu);
+       notEmpty.wait(locker, [this] { return closed || !buffer.empty(); });
+       size_t count = std::min(n, buffer.size());
+       auto end = buffer.begin() + count;
+       std::move(buffer.begin(), end, std::back_inserter(out));
+       buffer.erase(buffer.begin(), end);
+       depth.store(buffer.size(), std::memory_order_relaxed);
+       ++syncs;
+       bool more = !buffer.empty();
+       locker.unlock();
+       if (count)
+           notFull.notify_one();
+       if (more)
+           notEmpty.notify_one(); // Another consumer can take the rest.
+       return count;
+   }
+
+   void close() {
+       {
+           std::lock_guard<std::mutex> locker(mu);
+           closed = true;
+       }
+       notEmpty.notify_all();
+       notFull.notify_all();
+   }
+
+   // A hint only (read without the lock).
+   size_t depth_hint() const { return depth.load(std::memory_order_relaxed); }
+
+   size_t sync_count() {
+       std::lock_guard<std::mutex> locker(mu);
+       return syncs;
+   }
+
+private:
+   std::mutex mu;
+   std::condition_variable notEmpty, notFull;
+   std::deque<T> buffer;
+   const size_t maxBufferSize;
+   bool closed = false;
+   size_t syncs = 0;
+
+   std::atomic<size_t> depth{ 0 };
+};
+
+// Producer side buffer. maxBatch = 1 : no batching. adaptive = false : always fills maxBatch.
+template<class T>
+class Batcher {
+public:
+   Batcher(BatchQueue<T>& queue, size_t maxBatch, bool adaptive)
+       : queue(queue), maxBatch(maxBatch), adaptive(adaptive), target(adaptive ? 1 : maxBatch) {
+       local.reserve(maxBatch);
+   }
+
+   void add(T value) {
+       if (adaptive) {
+           auto now = std::chrono::steady_clock::now();
+           if (now - lastAdd > gapThreshold)
+               target = 1; // Light load : don't hold the item back.
+           lastAdd = now;
+       }
+       local.push_back(std::move(value));
+       if (local.size() >= target)
+           flush();
+   }
+
+   void flush() {
+       if (local.empty())
+           return;
+       queue.push_n(local.begin(), local.end());
+       local.clear();
+       if (adaptive)
+           target = std::clamp<size_t>(std::max(target * 2, queue.depth_hint() / 2), 1, maxBatch);
+   }
+
+   ~Batcher() { flush(); }
+
+private:
+   BatchQueue<T>& queue;
+   size_t maxBatch;
+   bool adaptive;
+   size_t target;
+   std::vector<T> local;
+
+   static constexpr std::chrono::microseconds gapThreshold{ 10 };
+   std::chrono::steady_clock::time_point lastAdd{};
+};
+
+using Clock = std::chrono::steady_clock;
+
+// Same queue depth for every config, so only batching differs.
+const size_t kQueueCapacity = 4096;
+
+// Full load : the producer pushes as fast as it can.
+void throughput(const char* name, size_t maxBatch, bool adaptive) {
+   const int N = 5000000;
+   BatchQueue<int> queue(kQueueCapacity);
+   bool inOrder = true;
+
+   auto t0 = Clock::now();
+   std::thread consumer([&] {
+       std::vector<int> got;
+       int expected = 0;
+       while (true) {
+           got.clear();
+           if (queue.pop_up_to(std::max<size_t>(1, maxBatch), got) == 0)
+               break;
+           for (int v : got)
+               inOrder &= (v == expected++);
+       }
+       inOrder &= (expected == N);
+   });
+   {
+       Batcher<int> batcher(queue, maxBatch, adaptive);
+       for (int i = 0; i < N; ++i)
+           batcher.add(i);
+   }
+   queue.close();
+   consumer.join();
+   double sec = std::chrono::duration<double>(Clock::now() - t0).count();
+   printf("%-22s %8.2f M items/s  %9zu lock round trips  %s\n", name, N / sec / 1e6,
+          queue.sync_count(), inOrder ? "FIFO ok" : "ORDER BROKEN");
+}
+
+// Light load : one item every 100 us, measure time from add() to the consumer.
+void latency(const char* name, size_t maxBatch, bool adaptive) {
+   const int N = 2000;
+   BatchQueue<Clock::time_point> queue(kQueueCapacity);
+   std::vector<double> us;
+   us.reserve(N);
+
+   std::thread consumer([&] {
+       std::vector<Clock::time_point> got;
+       while (true) {
+           got.clear();
+           if (queue.pop_up_to(maxBatch, got) == 0)
+               break;
+           auto now = Clock::now();
+           for (auto t : got)
+               us.push_back(std::chrono::duration<double, std::micro>(now - t).count());
+       }
+   });
+   {
+       Batcher<Clock::time_point> batcher(queue, maxBatch, adaptive);
+       for (int i = 0; i < N; ++i) {
+           batcher.add(Clock::now());
+           std::this_thread::sleep_for(std::chrono::microseconds(100));
+       }
+   }
+   queue.close();
+   consumer.join();
+   std::sort(us.begin(), us.end());
+   printf("%-22s p50 %9.1f us   p99 %9.1f us\n", name, us[us.size() / 2], us[us.size() * 99 / 100]);
+}
+
+int main() {
+   std::cout << "Full load (5M ints, 1 producer, 1 consumer)\n";
+   throughput("single item", 1, false);
+   throughput("fixed batch 64", 64, false);
+   throughput("adaptive batch <= 64", 64, true);
+
+   std::cout << "\nLight load (1 item / 100 us)\n";
+   latency("single item", 1, false);
+   latency("fixed batch 64", 64, false);
+   latency("adaptive batch <= 64", 64, true);
+   return 0;
+}
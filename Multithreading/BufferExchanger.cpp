@@ -0,0 +1,190 @@
+//====== Double / N-Buffer Producer/Consumer using Semaphore ======//
+//debug code please in c++ 20 environment. //
+
+//NOTES :
+//1. ProducerConsumerusingSemaphore.cpp has ONE buff[buff_size] and two binary_semaphores : the
+//   consumer waits while the producer fills, the producer waits while the consumer drains. Only one
+//   side works at any time, the total time is produce + consume.
+//2. BufferExchanger<T> owns N buffers of `bufferSize` items and passes their ownership around :
+//   a. acquire_empty() -> producer gets a free buffer (waits if all N are full / in use).
+//   b. publish(block)  -> the block goes to the consumer, nothing is copied, only an index moves.
+//   c. acquire_full()  -> consumer gets the oldest filled buffer (waits if none).
+//   d. release(block)  -> the buffer goes back to the producer.
+//   With N = 2 the producer fills A while the consumer drains B, then they swap. N > 2 absorbs
+//   jitter : a slow consumer step doesn't stall the producer right away.
+//3. Two counting_semaphores count the free and the filled buffers (the N = 1 case is exactly the
+//   binary_semaphore pair of the original). Buffers are used round robin and there is one producer
+//   and one consumer, so each side only needs its own index, no mutex. The semaphores'
+//   release/acquire also make the data written into a buffer visible to the other thread.
+//4. close() publishes an empty "last" block, the consumer stops when it sees it.
+//5. main() measures wall time vs produce + consume time (overlap factor, 2.0 = perfect overlap)
+//   for several buffer counts and sizes, and the raw hand-off rate.
+
+//Compile : g++ -std=c++20 -O2 -pthread BufferExchanger.cpp
+
+#include <chrono>
+#include <iostream>
+#include <semaphore>
+#include <thread>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <climits>
+using namespace std::chrono;
+using namespace std;
+
+template<class T>
+class BufferExchanger {
+public:
+   struct Block {
+       T* data = nullptr;
+       size_t capacity = 0;
+       size_t size = 0;     // Items filled by the producer.
+       size_t index = 0;
+       bool last = false;   // Set by close(), carries no data.
+   };
+
+   BufferExchanger(size_t bufferSize, size_t bufferCount)
+       : buffers(bufferCount, std::vector<T>(bufferSize)), slots(bufferCount),
+         freeBuffers(static_cast<ptrdiff_t>(bufferCount)), fullBuffers(0) {}
+
+   size_t buffer_size() const { return buffers.empty() ? 0 : buffers[0].size(); }
+   size_t buffer_count() const { return buffers.size(); }
+
+   // Producer thread only.
+   Block acquire_empty() {
+       freeBuffers.acquire();
+       size_t i = producerIndex;
+       producerIndex = (producerIndex + 1) % buffers.size();
+       return Block{ buffers[i].data(), buffers[i].size(), 0, i, false };
+   }
+
+   void publish(const Block& b) {
+       slots[b.index] = Slot{ b.size, b.last };
+       fullBuffers.release();
+   }
+
+   void close() {
+       Block b = acquire_empty();
+       b.last = true;
+       publish(b);
+   }
+
+   // Consumer thread only.
+   Block acquire_full() {
+       fullBuffers.acquire();
+       size_t i = consumerIndex;
+       consumerIndex = (consumerIndex + 1) % buffers.size();
+       return Block{ buffers[i].data(), buffers[i].size(), slots[i].size, i, slots[i].last };
+   }
+
+   void release(const Block&) {
+       freeBuffers.release();
+   }
+
+private:
+   // Only touched by whoever owns that buffer (not a vector<bool> : its bits share words).
+   struct Slot {
+       size_t size = 0;
+       bool last = false;
+   };
+
+   std::vector<std::vector<T>> buffers;
+   std::vector<Slot> slots;
+
+   std::counting_semaphore<INT_MAX> freeBuffers, fullBuffers;
+   size_t producerIndex = 0; // Producer only.
+   size_t consumerIndex = 0; // Consumer only.
+};
+
+// Stands for I/O or a device (like the sleep_for in the original), so overlap shows even on one core.
+void simulateWork(microseconds us) {
+   std::this_thread::sleep_for(us);
+}
+
+// Each block costs ~costUs per side, with random jitter of +-jitterUs.
+void overlapBench(size_t bufferSize, size_t bufferCount, int blocks, int costUs, int jitterUs) {
+   BufferExchanger<int> ex(bufferSize, bufferCount);
+   microseconds produceTime{ 0 }, consumeTime{ 0 };
+   long long expected = 0, got = 0;
+
+   auto t0 = steady_clock::now();
+   std::thread consumer_thread([&] {
+       std::mt19937 rng(2);
+       while (true) {
+           auto b = ex.acquire_full();
+           if (b.last) {
+               ex.release(b);
+               break;
+           }
+           auto s = steady_clock::now();
+           for (size_t i = 0; i < b.size; ++i)
+               got += b.data[i]; // task of consumer
+           simulateWork(microseconds(costUs + static_cast<int>(rng() % (2 * jitterUs + 1)) - jitterUs));
+           consumeTime += duration_cast<microseconds>(steady_clock::now() - s);
+           ex.release(b);
+       }
+   });
+
+   std::mt19937 rng(1);
+   for (int n = 0; n < blocks; ++n) {
+       auto b = ex.acquire_empty();
+       auto s = steady_clock::now();
+       for (size_t i = 0; i < b.capacity; ++i) {
+           b.data[i] = static_cast<int>(i * i); // task of producer
+           expected += b.data[i];
+       }
+       b.size = b.capacity;
+       simulateWork(microseconds(costUs + static_cast<int>(rng() % (2 * jitterUs + 1)) - jitterUs));
+       produceTime += duration_cast<microseconds>(steady_clock::now() - s);
+       ex.publish(b);
+   }
+   ex.close();
+   consumer_thread.join();
+
+   auto wall = duration_cast<microseconds>(steady_clock::now() - t0);
+   double overlap = double((produceTime + consumeTime).count()) / wall.count();
+   double itemsPerSec = double(blocks) * bufferSize / (wall.count() / 1e6);
+   printf("buffers %2zu x %5zu   wall %7.1f ms   overlap %.2f   %8.2f M items/s   %s\n", bufferCount,
+          bufferSize, wall.count() / 1000.0, overlap, itemsPerSec / 1e6, got == expected ? "ok" : "MISMATCH");
+}
+
+// No simulated work : how fast can blocks change hands.
+void handoffBench(size_t bufferSize, size_t bufferCount) {
+   const int blocks = 200000;
+   BufferExchanger<int> ex(bufferSize, bufferCount);
+   auto t0 = steady_clock::now();
+   std::thread consumer_thread([&] {
+       while (true) {
+           auto b = ex.acquire_full();
+           ex.release(b);
+           if (b.last)
+               break;
+       }
+   });
+   for (int n = 0; n < blocks; ++n) {
+       auto b = ex.acquire_empty();
+       b.size = b.capacity;
+       ex.publish(b);
+   }
+   ex.close();
+   consumer_thread.join();
+   double sec = duration<double>(steady_clock::now() - t0).count();
+   printf("hand-off, %2zu buffers : %8.2f M blocks/s\n", bufferCount, blocks / sec / 1e6);
+}
+
+int main()
+{
+   const int blocks = 200, costUs = 500, jitterUs = 400;
+   cout << "Producer and consumer each spend ~" << costUs << " us per block (+-" << jitterUs << " us)\n";
+   cout << "1 buffer = the original take-turns scheme\n";
+   for (size_t count : { 1, 2, 4, 8 })
+       overlapBench(1024, count, blocks, costUs, jitterUs);
+   for (size_t size : { 64, 16384 })
+       overlapBench(size, 2, blocks, costUs, jitterUs);
+
+   cout << "\n";
+   for (size_t count : { 1, 2, 8 })
+       handoffBench(1024, count);
+   return 0;
+}
@@ -0,0 +1,183 @@
+//****** Thread Pool with batch enqueue and parallel_for ******//
+
+//NOTES :
+//1. In ThreadPool.cpp every enqueue takes the mutex and calls notify_one, so submitting 10k tasks
+//   means 10k lock/unlock + 10k notify calls, while the workers are fighting for the same mutex.
+//2. enqueue_bulk(first, last) :
+//   a. Inserts the whole range under ONE lock.
+//   b. Wakes only as many workers as the batch needs : min(batch size, idle workers).
+//      If the batch can use every idle worker, one notify_all replaces many notify_one calls.
+//3. parallel_for(begin, end, grain, fn) :
+//   a. Cuts [begin, end) into chunks of `grain` indices, fn(i) is called for every index.
+//   b. All chunks go in with one enqueue_bulk, then the caller waits for the last chunk.
+//   c. Call it from outside the pool (e.g. main), a worker waiting on its own chunks could deadlock.
+//4. The pool counts idle workers itself (the ones parked in condition.wait), so it knows how
+//   many wakeups are useful.
+
+//Compile : g++ -std=c++17 -O2 -pthread BulkEnqueueThreadPool.cpp
+
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <iterator>
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+
+class ThreadPool {
+public:
+   ThreadPool(size_t numThreads) : stop(false), idle(0), notifyCalls(0) {
+       for (size_t i = 0; i < numThreads; ++i) {
+           workers.emplace_back([this] {
+               for (;;) {
+                   std::unique_lock<std::mutex> lock(queueMutex);
+                   ++idle;
+                   condition.wait(lock, [this] { return stop || !tasks.empty(); });
+                   --idle;
+                   if (stop && tasks.empty())
+                       return;
+                   auto task = std::move(tasks.front());
+                   tasks.pop();
+                   lock.unlock();
+                   task();
+               }
+               });
+       }
+   }
+
+   template<class F>
+   void enqueue(F&& task) {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       tasks.emplace(std::forward<F>(task));
+       lock.unlock();
+       condition.notify_one();
+       notifyCalls.fetch_add(1, std::memory_order_relaxed);
+   }
+
+   // Inserts every task in [first, last) under one lock. Pass move iterators to avoid copies.
+   template<class It>
+   void enqueue_bulk(It first, It last) {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       size_t added = 0;
+       for (; first != last; ++first, ++added)
+           tasks.emplace(*first);
+       size_t wake = std::min(added, idle);
+       bool everyone = (wake == idle);
+       lock.unlock();
+
+       if (wake == 0)
+           return;
+       if (everyone) {
+           condition.notify_all();
+           notifyCalls.fetch_add(1, std::memory_order_relaxed);
+       }
+       else {
+           for (size_t i = 0; i < wake; ++i)
+               condition.notify_one();
+           notifyCalls.fetch_add(wake, std::memory_order_relaxed);
+       }
+   }
+
+   // Calls fn(i) for every i in [begin, end), in chunks of `grain`, and returns when all are done.
+   template<class Index, class F>
+   void parallel_for(Index begin, Index end, Index grain, F fn) {
+       if (begin >= end)
+           return;
+       if (grain < 1)
+           grain = 1;
+
+       struct Latch {
+           std::mutex mutex;
+           std::condition_variable cv;
+           size_t remaining;
+       } latch;
+
+       std::vector<std::function<void()>> chunks;
+       Index lo = begin;
+       while (lo < end) {
+           Index hi = (end - lo > grain) ? lo + grain : end;
+           chunks.emplace_back([lo, hi, &fn, &latch] {
+               for (Index i = lo; i < hi; ++i)
+                   fn(i);
+               std::lock_guard<std::mutex> lock(latch.mutex);
+               if (--latch.remaining == 0)
+                   latch.cv.notify_one();
+           });
+           lo = hi;
+       }
+       latch.remaining = chunks.size();
+       enqueue_bulk(std::make_move_iterator(chunks.begin()), std::make_move_iterator(chunks.end()));
+
+       std::unique_lock<std::mutex> lock(latch.mutex);
+       latch.cv.wait(lock, [&latch] { return latch.remaining == 0; });
+   }
+
+   size_t notify_calls() const { return notifyCalls.load(); }
+
+   ~ThreadPool() {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       stop = true;
+       lock.unlock();
+       condition.notify_all();
+       for (std::thread& worker : workers)
+           worker.join();
+   }
+
+private:
+   std::vector<std::thread> workers;
+   std::queue<std::function<void()>> tasks;
+
+   std::mutex queueMutex;
+   std::condition_variable condition;
+   bool stop;
+   size_t idle; // Workers parked in condition.wait, guarded by queueMutex.
+   std::atomic<size_t> notifyCalls;
+};
+
+int main() {
+   const int N = 10000;
+   std::atomic<int> done(0);
+   auto work = [&done] { done.fetch_add(1, std::memory_order_relaxed); };
+
+   // 1. One enqueue per task, like the loop in ThreadPool.cpp.
+   {
+       ThreadPool pool(8);
+       auto t0 = std::chrono::steady_clock::now();
+       for (int i = 0; i < N; ++i)
+           pool.enqueue(work);
+       while (done.load() < N)
+           std::this_thread::yield();
+       auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+       std::cout << "enqueue x" << N << "     : " << us << " us, notify calls " << pool.notify_calls() << "\n";
+   }
+
+   // 2. The same tasks in one batch.
+   done = 0;
+   {
+       ThreadPool pool(8);
+       std::this_thread::sleep_for(std::chrono::milliseconds(10)); // Let the workers park.
+       std::vector<std::function<void()>> batch(N, work);
+       auto t0 = std::chrono::steady_clock::now();
+       pool.enqueue_bulk(std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+       while (done.load() < N)
+           std::this_thread::yield();
+       auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+       std::cout << "enqueue_bulk(" << N << ") : " << us << " us, notify calls " << pool.notify_calls() << "\n";
+   }
+
+   // 3. parallel_for : square a million numbers in chunks of 10k.
+   {
+       ThreadPool pool(8);
+       std::vector<long long> values(1000000);
+       std::iota(values.begin(), values.end(), 0);
+       pool.parallel_for<size_t>(0, values.size(), 10000, [&values](size_t i) { values[i] *= values[i]; });
+       std::cout << "parallel_for : values[999999] = " << values[999999]
+                 << ", notify calls " << pool.notify_calls() << "\n";
+   }
+   return 0;
+}
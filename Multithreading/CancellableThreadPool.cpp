@@ -0,0 +1,274 @@
+//****** Thread Pool with cooperative cancellation and shutdown modes ******//
+
+//NOTES :
+//1. ~ThreadPool in ThreadPool.cpp sets stop and joins, and the workers keep going until the queue
+//   is empty. On shutdown or overload that means running (and holding memory for) work nobody
+//   needs any more.
+//2. StopToken : a task may take a StopToken parameter and poll token.stop_requested() in its
+//   loops. Cancellation is COOPERATIVE, a running task is never killed, it is asked to return early.
+//   Stop state is per submission, not per pool : enqueue(task, source) ties the task to a StopSource
+//   the caller owns (a shared flag), and source.request_stop() stops only the tasks given that
+//   source. Every token also sees the pool-wide flag, which only shutdown(Discard) sets. A flag that
+//   stayed set for the whole pool would cancel every later submission too.
+//3. cancel_pending() throws away every queued (not yet started) task. The queue is swapped out
+//   under the lock and destroyed outside it, so the captures are freed right away.
+//4. shutdown(mode) :
+//   a. ShutdownMode::Drain    -> run everything already queued, then stop (old destructor behaviour).
+//   b. ShutdownMode::Discard  -> drop queued tasks, ask running tasks to stop, join.
+//   c. ShutdownMode::Deadline -> drain until the deadline, then behave like Discard.
+//   After shutdown starts, enqueue returns false and the task is not queued.
+//   shutdown() is safe to call from several threads : the first caller does the work (and joins),
+//   the others wait until it has finished and return 0.
+//5. The destructor still drains if shutdown() was never called.
+
+//Compile : g++ -std=c++17 -O2 -pthread CancellableThreadPool.cpp
+
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+#include <memory>
+
+class StopToken {
+public:
+   StopToken(std::shared_ptr<const std::atomic<bool>> own, const std::atomic<bool>* pool)
+       : own(std::move(own)), pool(pool) {}
+   bool stop_requested() const {
+       return pool->load(std::memory_order_relaxed) || (own && own->load(std::memory_order_relaxed));
+   }
+
+private:
+   std::shared_ptr<const std::atomic<bool>> own; // Null for tasks enqueued without a StopSource.
+   const std::atomic<bool>* pool;
+};
+
+// Owned by the caller, shared with the tasks it is passed to. Copies share the same flag.
+class StopSource {
+public:
+   StopSource() : flag(std::make_shared<std::atomic<bool>>(false)) {}
+   void request_stop() { flag->store(true, std::memory_order_relaxed); }
+   bool stop_requested() const { return flag->load(std::memory_order_relaxed); }
+
+private:
+   friend class ThreadPool;
+   std::shared_ptr<std::atomic<bool>> flag;
+};
+
+enum class ShutdownMode { Drain, Discard, Deadline };
+
+class ThreadPool {
+public:
+   ThreadPool(size_t numThreads)
+       : stop(false), accepting(true), shuttingDown(false), shutDown(false), active(0), stopRequested(false) {
+       for (size_t i = 0; i < numThreads; ++i) {
+           workers.emplace_back([this] {
+               for (;;) {
+                   std::unique_lock<std::mutex> lock(queueMutex);
+                   condition.wait(lock, [this] { return stop || !tasks.empty(); });
+                   if (stop && tasks.empty())
+                       return;
+                   auto task = std::move(tasks.front());
+                   tasks.pop();
+                   ++active;
+                   lock.unlock();
+                   task();
+                   task = nullptr;
+                   lock.lock();
+                   if (--active == 0 && tasks.empty())
+                       idle.notify_all();
+               }
+               });
+       }
+   }
+
+   // F may be callable as f() or as f(StopToken). Returns false once shutdown has started.
+   template<class F>
+   bool enqueue(F&& task) {
+       return push(std::forward<F>(task), nullptr);
+   }
+
+   // Same, but the task's token also sees source.request_stop().
+   template<class F>
+   bool enqueue(F&& task, const StopSource& source) {
+       return push(std::forward<F>(task), source.flag);
+   }
+
+   // Drops every task that has not started yet. Returns how many were dropped.
+   size_t cancel_pending() {
+       std::queue<std::function<void()>> dropped;
+       {
+           std::lock_guard<std::mutex> lock(queueMutex);
+           dropped.swap(tasks);
+           if (active == 0)
+               idle.notify_all();
+       }
+       return dropped.size(); // Captures are destroyed here, outside the lock.
+   }
+
+   // Returns the number of queued tasks that were discarded (0 for every caller but the first).
+   size_t shutdown(ShutdownMode mode, std::chrono::milliseconds deadline = std::chrono::milliseconds(0)) {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       if (shuttingDown) {
+           finished.wait(lock, [this] { return shutDown; }); // Someone else is (or was) joining.
+           return 0;
+       }
+       shuttingDown = true;
+       accepting = false;
+       lock.unlock();
+
+       size_t discarded = 0;
+       if (mode == ShutdownMode::Deadline) {
+           lock.lock();
+           bool drained = idle.wait_for(lock, deadline, [this] { return active == 0 && tasks.empty(); });
+           lock.unlock();
+           if (!drained)
+               mode = ShutdownMode::Discard;
+       }
+       if (mode == ShutdownMode::Discard) {
+           stopRequested.store(true, std::memory_order_relaxed); // Running tasks return early.
+           discarded = cancel_pending();
+       }
+
+       lock.lock();
+       stop = true;
+       lock.unlock();
+       condition.notify_all();
+       for (std::thread& worker : workers)
+           worker.join();
+
+       lock.lock();
+       shutDown = true;
+       lock.unlock();
+       finished.notify_all();
+       return discarded;
+   }
+
+   ~ThreadPool() {
+       shutdown(ShutdownMode::Drain);
+   }
+
+private:
+   template<class F>
+   bool push(F&& task, std::shared_ptr<std::atomic<bool>> own) {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       if (!accepting)
+           return false;
+       if constexpr (std::is_invocable_v<std::decay_t<F>, StopToken>)
+           tasks.emplace([this, own = std::move(own), fn = std::forward<F>(task)]() mutable {
+               fn(StopToken(std::move(own), &stopRequested));
+           });
+       else
+           tasks.emplace(std::forward<F>(task));
+       lock.unlock();
+       condition.notify_one();
+       return true;
+   }
+
+   std::vector<std::thread> workers;
+   std::queue<std::function<void()>> tasks;
+
+   std::mutex queueMutex;
+   std::condition_variable condition;
+   std::condition_variable idle;     // Signalled when nothing is queued or running.
+   std::condition_variable finished; // Signalled when the first shutdown() has joined the workers.
+   bool stop;
+   bool accepting;
+   bool shuttingDown; // A shutdown() call has started. Only that call joins.
+   bool shutDown;     // ... and has finished.
+   size_t active;
+   std::atomic<bool> stopRequested; // Pool-wide, set only by shutdown(Discard).
+};
+
+// Counts live payloads, so we can see when queued captures are really freed.
+std::atomic<int> livePayloads(0);
+
+struct Payload {
+   std::vector<char> bytes = std::vector<char>(1 << 20); // 1 MB
+   Payload() { ++livePayloads; }
+   Payload(const Payload& o) : bytes(o.bytes) { ++livePayloads; }
+   ~Payload() { --livePayloads; }
+};
+
+// A long task that checks its token every millisecond.
+auto makeJob(std::atomic<int>& finished, std::atomic<int>& cancelled) {
+   return [&finished, &cancelled, payload = Payload()](StopToken token) {
+       for (int step = 0; step < 100; ++step) {
+           if (token.stop_requested()) {
+               ++cancelled;
+               return;
+           }
+           std::this_thread::sleep_for(std::chrono::milliseconds(1));
+       }
+       (void)payload;
+       ++finished;
+   };
+}
+
+void run(const char* name, ShutdownMode mode, std::chrono::milliseconds deadline = std::chrono::milliseconds(0)) {
+   std::atomic<int> finished(0), cancelled(0);
+   ThreadPool pool(4);
+   for (int i = 0; i < 40; ++i)
+       pool.enqueue(makeJob(finished, cancelled));
+   std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+   auto t0 = std::chrono::steady_clock::now();
+   size_t discarded = pool.shutdown(mode, deadline);
+   auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+   bool accepted = pool.enqueue([] {});
+   printf("%-9s shutdown %4lld ms : finished %2d  cancelled %2d  discarded %2zu  live MB %d  enqueue after %s\n",
+          name, static_cast<long long>(ms), finished.load(), cancelled.load(), discarded, livePayloads.load(),
+          accepted ? "accepted" : "rejected");
+}
+
+int main() {
+   run("Drain", ShutdownMode::Drain);
+   run("Discard", ShutdownMode::Discard);
+   run("Deadline", ShutdownMode::Deadline, std::chrono::milliseconds(250));
+
+   // cancel_pending on a live pool : queued captures are freed at once.
+   std::atomic<int> finished(0), cancelled(0);
+   ThreadPool pool(2);
+   for (int i = 0; i < 20; ++i)
+       pool.enqueue(makeJob(finished, cancelled));
+   printf("Before cancel_pending : live MB %d\n", livePayloads.load());
+   size_t dropped = pool.cancel_pending();
+   printf("After  cancel_pending : live MB %d (dropped %zu)\n", livePayloads.load(), dropped);
+
+   // Per-submission stop : only the tasks given `first` are asked to stop, the second batch runs on.
+   {
+       std::atomic<int> done(0), stopped(0);
+       ThreadPool batches(4);
+       StopSource first, second;
+       for (int i = 0; i < 4; ++i) {
+           batches.enqueue(makeJob(done, stopped), first);
+           batches.enqueue(makeJob(done, stopped), second);
+       }
+       std::this_thread::sleep_for(std::chrono::milliseconds(20));
+       first.request_stop();
+       batches.shutdown(ShutdownMode::Drain);
+       printf("Stop one batch of 4   : finished %d  cancelled %d\n", done.load(), stopped.load());
+   }
+
+   // Concurrent shutdown : one call joins, the others wait for it.
+   {
+       std::atomic<int> done(0), stopped(0);
+       ThreadPool shared(4);
+       for (int i = 0; i < 8; ++i)
+           shared.enqueue(makeJob(done, stopped));
+       std::vector<std::thread> callers;
+       std::atomic<size_t> discarded(0);
+       for (int i = 0; i < 3; ++i)
+           callers.emplace_back([&] { discarded += shared.shutdown(ShutdownMode::Discard); });
+       for (std::thread& caller : callers)
+           caller.join();
+       printf("3 concurrent shutdown : finished %d  cancelled %d  discarded %zu\n", done.load(), stopped.load(),
+              discarded.load());
+   }
+   return 0;
+}
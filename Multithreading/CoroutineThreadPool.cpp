@@ -0,0 +1,590 @@
+//****** C++20 Coroutines on a Thread Pool ******//
+//debug code please in c++ 20 environment. //
+
+//NOTES :
+//1. Async.cpp chains work with std::async : every step is a new thread (or a deferred call) and
+//   the caller blocks on future.get() between steps. Coroutines let us write the same pipeline
+//   as straight-line code that SUSPENDS instead of blocking a thread.
+//2. task<T> : a lazy coroutine. It starts when it is co_awaited and resumes its awaiter when it
+//   finishes (symmetric transfer, no extra thread, no extra queue hop).
+//3. Awaitables provided by the pool :
+//   a. co_await pool.schedule()       -> continue on a pool worker.
+//   b. co_await pool.sleep_for(d)     -> one timer thread keeps a min-heap of deadlines and hands
+//                                         the coroutine back to the pool when it is due. No worker
+//                                         sleeps.
+//   c. co_await pool.submit(fn)       -> submit returns a Future<T>, awaiting it resumes the
+//                                         coroutine on the pool once fn has run (T may be void).
+//4. sync_wait(task) : blocks a NON pool thread (main) until the task is done and returns its value.
+//5. Coroutine frames come from FramePool : power-of-two size classes with per-thread free lists,
+//   so in steady state creating a coroutine reuses a frame instead of calling malloc. A frame
+//   freed on another thread goes back (lock-free push) to the thread that allocated it, so
+//   frames don't pile up on the workers that happen to finish coroutines.
+
+//Compile : g++ -std=c++20 -O2 -pthread CoroutineThreadPool.cpp
+
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <optional>
+#include <variant>
+#include <exception>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+//====== Frame allocator ======//
+
+class FramePool {
+public:
+   static constexpr size_t MinBlock = 64;
+   static constexpr size_t Classes = 8; // 64 B ... 8 KB, header included
+
+   static void* allocate(size_t size) {
+       size_t c = sizeClass(size + sizeof(Header));
+       Owner* o = c < Classes ? currentOwner() : nullptr;
+       if (!o) {
+           if (c == Classes)
+               oversized.fetch_add(1, std::memory_order_relaxed);
+           return carve(nullptr, c, size + sizeof(Header));
+       }
+       Node* n = o->heads[c];
+       if (!n) // Local list empty : take back everything other threads returned to us.
+           n = o->remote[c].exchange(nullptr, std::memory_order_acquire);
+       if (n) {
+           o->heads[c] = n->next;
+           reused.fetch_add(1, std::memory_order_relaxed);
+           return n;
+       }
+       fresh.fetch_add(1, std::memory_order_relaxed);
+       o->refs.fetch_add(1, std::memory_order_relaxed);
+       return carve(o, c, MinBlock << c);
+   }
+
+   // A frame often dies on another thread than where it was born. It goes back to the thread
+   // that allocated it, so a coroutine started by main and finished by a worker is reused by main.
+   static void deallocate(void* p, size_t) {
+       Header* h = static_cast<Header*>(p) - 1;
+       Owner* o = h->owner;
+       if (!o) {
+           ::operator delete(h);
+           return;
+       }
+       Node* n = static_cast<Node*>(p);
+       if (o == tlsOwner) {
+           n->next = o->heads[h->sizeClass];
+           o->heads[h->sizeClass] = n;
+           return;
+       }
+       remoteFree(o, h->sizeClass, n);
+   }
+
+   static std::atomic<size_t> fresh;     // Blocks taken from the heap.
+   static std::atomic<size_t> reused;    // Blocks taken from a free list.
+   static std::atomic<size_t> oversized; // Frames too big for any class.
+
+private:
+   struct Node { Node* next; };
+
+   // One per thread. It outlives its thread while blocks it carved are still in use elsewhere.
+   struct Owner {
+       Node* heads[Classes] = {};                // Owner thread only.
+       std::atomic<Node*> remote[Classes] = {};  // Pushed by other threads, taken all at once.
+       std::atomic<size_t> refs{ 1 };            // The thread + every block carved and not yet deleted.
+       std::atomic<bool> dead{ false };          // The thread has exited.
+   };
+
+   // In front of every block. 16 bytes, so the frame keeps the alignment of operator new.
+   struct alignas(16) Header {
+       Owner* owner; // nullptr : plain heap block.
+       size_t sizeClass;
+   };
+
+   // Thread exit : frees the cached blocks, marks the owner dead, drops the thread reference.
+   struct OwnerGuard {
+       ~OwnerGuard() {
+           Owner* o = tlsOwner;
+           tlsOwner = nullptr;
+           tlsRetired = true;
+           size_t freed = 0;
+           for (Node*& head : o->heads)
+               freed += freeList(std::exchange(head, nullptr));
+           o->dead.store(true);
+           freed += drainRemote(o);
+           o->refs.fetch_sub(freed);
+           release(o);
+       }
+   };
+
+   static Owner* currentOwner() {
+       if (tlsOwner || tlsRetired)
+           return tlsOwner; // nullptr while the thread is exiting : plain heap blocks then.
+       tlsOwner = new Owner;
+       thread_local OwnerGuard guard; // Registers the exit hook, once per thread.
+       (void)guard;
+       return tlsOwner;
+   }
+
+   static void* carve(Owner* o, size_t c, size_t bytes) {
+       Header* h = static_cast<Header*>(::operator new(bytes));
+       h->owner = o;
+       h->sizeClass = c;
+       return h + 1;
+   }
+
+   static void remoteFree(Owner* o, size_t c, Node* n) {
+       o->refs.fetch_add(1); // Keeps o alive until we are done with it.
+       n->next = o->remote[c].load(std::memory_order_relaxed);
+       while (!o->remote[c].compare_exchange_weak(n->next, n))
+           ;
+       // Either the exiting owner drains after our push, or we see it dead and drain ourselves.
+       if (o->dead.load())
+           o->refs.fetch_sub(drainRemote(o));
+       release(o);
+   }
+
+   static size_t drainRemote(Owner* o) {
+       size_t freed = 0;
+       for (auto& list : o->remote)
+           freed += freeList(list.exchange(nullptr));
+       return freed;
+   }
+
+   static size_t freeList(Node* head) {
+       size_t count = 0;
+       while (head) {
+           Node* next = head->next;
+           ::operator delete(reinterpret_cast<Header*>(head) - 1);
+           head = next;
+           ++count;
+       }
+       return count;
+   }
+
+   static void release(Owner* o) {
+       if (o->refs.fetch_sub(1) == 1)
+           delete o;
+   }
+
+   static size_t sizeClass(size_t size) {
+       size_t c = 0;
+       while (c < Classes && (MinBlock << c) < size)
+           ++c;
+       return c;
+   }
+
+   static thread_local Owner* tlsOwner;  // Trivial : no TLS init guard on the fast path.
+   static thread_local bool tlsRetired;
+};
+
+std::atomic<size_t> FramePool::fresh(0);
+std::atomic<size_t> FramePool::reused(0);
+std::atomic<size_t> FramePool::oversized(0);
+thread_local FramePool::Owner* FramePool::tlsOwner = nullptr;
+thread_local bool FramePool::tlsRetired = false;
+
+// Every promise type derives from this, so every coroutine frame uses FramePool.
+struct PooledFrame {
+   static void* operator new(size_t size) { return FramePool::allocate(size); }
+   static void operator delete(void* p, size_t size) { FramePool::deallocate(p, size); }
+};
+
+//====== task<T> ======//
+
+template<class T>
+class task;
+
+namespace detail {
+
+struct PromiseBase : PooledFrame {
+   std::coroutine_handle<> continuation;
+   std::exception_ptr error;
+
+   std::suspend_always initial_suspend() noexcept { return {}; }
+
+   struct FinalAwaiter {
+       bool await_ready() noexcept { return false; }
+       template<class P>
+       std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+           auto next = h.promise().continuation;
+           return next ? next : std::noop_coroutine();
+       }
+       void await_resume() noexcept {}
+   };
+   FinalAwaiter final_suspend() noexcept { return {}; }
+
+   void unhandled_exception() { error = std::current_exception(); }
+};
+
+template<class T>
+struct Promise : PromiseBase {
+   std::optional<T> value;
+   task<T> get_return_object();
+   void return_value(T v) { value.emplace(std::move(v)); }
+   T result() {
+       if (error)
+           std::rethrow_exception(error);
+       return std::move(*value);
+   }
+};
+
+template<>
+struct Promise<void> : PromiseBase {
+   task<void> get_return_object();
+   void return_void() {}
+   void result() {
+       if (error)
+           std::rethrow_exception(error);
+   }
+};
+
+} // namespace detail
+
+template<class T = void>
+class task {
+public:
+   using promise_type = detail::Promise<T>;
+
+   explicit task(std::coroutine_handle<promise_type> h) : handle(h) {}
+   task(task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+   task(const task&) = delete;
+   task& operator=(const task&) = delete;
+   ~task() {
+       if (handle)
+           handle.destroy();
+   }
+
+   // Awaiting a task starts it and resumes us when it finishes.
+   bool await_ready() const noexcept { return false; }
+   std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+       handle.promise().continuation = awaiting;
+       return handle;
+   }
+   T await_resume() { return handle.promise().result(); }
+
+private:
+   std::coroutine_handle<promise_type> handle;
+};
+
+namespace detail {
+
+template<class T>
+task<T> Promise<T>::get_return_object() {
+   return task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline task<void> Promise<void>::get_return_object() {
+   return task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// Starts immediately and frees its own frame at the end. Used by sync_wait only.
+struct DetachedTask {
+   struct promise_type : PooledFrame {
+       DetachedTask get_return_object() { return {}; }
+       std::suspend_never initial_suspend() noexcept { return {}; }
+       std::suspend_never final_suspend() noexcept { return {}; }
+       void return_void() {}
+       void unhandled_exception() { std::terminate(); }
+   };
+};
+
+} // namespace detail
+
+//====== Future returned by submit ======//
+
+template<class T>
+class Future {
+public:
+   struct State {
+       std::mutex mutex;
+       bool ready = false;
+       std::optional<std::conditional_t<std::is_void_v<T>, std::monostate, T>> value;
+       std::exception_ptr error;
+       std::coroutine_handle<> waiter;
+   };
+
+   explicit Future(std::shared_ptr<State> state) : state(std::move(state)) {}
+
+   bool await_ready() const {
+       std::lock_guard<std::mutex> lock(state->mutex);
+       return state->ready;
+   }
+   bool await_suspend(std::coroutine_handle<> h); // Defined after ThreadPool.
+   T await_resume() {
+       if (state->error)
+           std::rethrow_exception(state->error);
+       if constexpr (!std::is_void_v<T>)
+           return std::move(*state->value);
+   }
+
+private:
+   std::shared_ptr<State> state;
+};
+
+//====== Thread pool with timer ======//
+
+class ThreadPool {
+public:
+   using Clock = std::chrono::steady_clock;
+
+   ThreadPool(size_t numThreads) : stop(false) {
+       for (size_t i = 0; i < numThreads; ++i) {
+           workers.emplace_back([this] {
+               for (;;) {
+                   std::unique_lock<std::mutex> lock(queueMutex);
+                   condition.wait(lock, [this] { return stop || !tasks.empty(); });
+                   if (stop && tasks.empty())
+                       return;
+                   auto task = std::move(tasks.front());
+                   tasks.pop();
+                   lock.unlock();
+                   task();
+               }
+               });
+       }
+       timerThread = std::thread([this] { timerLoop(); });
+   }
+
+   template<class F>
+   void enqueue(F&& task) {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       tasks.emplace(std::forward<F>(task));
+       lock.unlock();
+       condition.notify_one();
+   }
+
+   void resume_on_pool(std::coroutine_handle<> h) {
+       enqueue([h] { h.resume(); });
+   }
+
+   // co_await pool.schedule() : the rest of the coroutine runs on a worker.
+   auto schedule() {
+       struct Awaiter {
+           ThreadPool& pool;
+           bool await_ready() const noexcept { return false; }
+           void await_suspend(std::coroutine_handle<> h) { pool.resume_on_pool(h); }
+           void await_resume() const noexcept {}
+       };
+       return Awaiter{ *this };
+   }
+
+   // co_await pool.sleep_for(d) : suspends without holding any thread.
+   auto sleep_for(Clock::duration d) {
+       struct Awaiter {
+           ThreadPool& pool;
+           Clock::time_point due;
+           bool await_ready() const noexcept { return due <= Clock::now(); }
+           void await_suspend(std::coroutine_handle<> h) { pool.addTimer(due, h); }
+           void await_resume() const noexcept {}
+       };
+       return Awaiter{ *this, Clock::now() + d };
+   }
+
+   // Runs fn() on the pool. The returned Future can be co_awaited.
+   template<class F>
+   auto submit(F fn) -> Future<decltype(fn())> {
+       using T = decltype(fn());
+       auto state = std::make_shared<typename Future<T>::State>();
+       enqueue([this, state, fn = std::move(fn)]() mutable {
+           try {
+               if constexpr (std::is_void_v<T>) {
+                   fn();
+                   state->value.emplace();
+               }
+               else {
+                   state->value.emplace(fn());
+               }
+           }
+           catch (...) {
+               state->error = std::current_exception();
+           }
+           std::coroutine_handle<> waiter;
+           {
+               std::lock_guard<std::mutex> lock(state->mutex);
+               state->ready = true;
+               waiter = state->waiter;
+           }
+           if (waiter)
+               resume_on_pool(waiter);
+       });
+       return Future<T>(state);
+   }
+
+   ~ThreadPool() {
+       {
+           std::lock_guard<std::mutex> lock(timerMutex);
+           timerStop = true;
+       }
+       timerCondition.notify_one();
+       timerThread.join();
+
+       std::unique_lock<std::mutex> lock(queueMutex);
+       stop = true;
+       lock.unlock();
+       condition.notify_all();
+       for (std::thread& worker : workers)
+           worker.join();
+   }
+
+private:
+   struct Timer {
+       Clock::time_point due;
+       std::coroutine_handle<> handle;
+       bool operator>(const Timer& o) const { return due > o.due; }
+   };
+
+   void addTimer(Clock::time_point due, std::coroutine_handle<> h) {
+       bool earliest;
+       {
+           std::lock_guard<std::mutex> lock(timerMutex);
+           timers.push(Timer{ due, h });
+           earliest = timers.top().handle == h;
+       }
+       if (earliest)
+           timerCondition.notify_one(); // New head : the timer thread must shorten its sleep.
+   }
+
+   void timerLoop() {
+       std::unique_lock<std::mutex> lock(timerMutex);
+       while (!timerStop) {
+           if (timers.empty()) {
+               timerCondition.wait(lock);
+               continue;
+           }
+           auto due = timers.top().due;
+           if (due > Clock::now()) {
+               timerCondition.wait_until(lock, due);
+               continue;
+           }
+           auto h = timers.top().handle;
+           timers.pop();
+           lock.unlock();
+           resume_on_pool(h);
+           lock.lock();
+       }
+   }
+
+   std::vector<std::thread> workers;
+   std::queue<std::function<void()>> tasks;
+
+   std::mutex queueMutex;
+   std::condition_variable condition;
+   bool stop;
+
+   std::thread timerThread;
+   std::mutex timerMutex;
+   std::condition_variable timerCondition;
+   std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+   bool timerStop = false;
+};
+
+template<class T>
+bool Future<T>::await_suspend(std::coroutine_handle<> h) {
+   std::lock_guard<std::mutex> lock(state->mutex);
+   if (state->ready)
+       return false; // Finished meanwhile, don't suspend.
+   state->waiter = h;
+   return true;
+}
+
+// Blocks the calling (non pool) thread until t is finished.
+template<class T>
+T sync_wait(task<T> t) {
+   std::mutex m;
+   std::condition_variable cv;
+   bool done = false;
+   std::optional<std::conditional_t<std::is_void_v<T>, int, T>> result;
+   std::exception_ptr error;
+
+   auto waiter = [&]() -> detail::DetachedTask {
+       try {
+           if constexpr (std::is_void_v<T>)
+               co_await std::move(t);
+           else
+               result.emplace(co_await std::move(t));
+       }
+       catch (...) {
+           error = std::current_exception();
+       }
+       std::lock_guard<std::mutex> lock(m);
+       done = true;
+       cv.notify_one(); // Under the lock, sync_wait may return right after.
+   };
+   waiter();
+
+   std::unique_lock<std::mutex> lock(m);
+   cv.wait(lock, [&] { return done; });
+   if (error)
+       std::rethrow_exception(error);
+   if constexpr (!std::is_void_v<T>)
+       return std::move(*result);
+}
+
+//====== Demo pipeline ======//
+
+typedef long int ull;
+
+ull findOdd(ull start, ull end) {
+   ull OddSum = 0;
+   for (ull i = start; i <= end; ++i) {
+       if (i & 1) {
+           OddSum += i;
+       }
+   }
+   return OddSum;
+}
+
+// Stage 1 : "fetch" a range, simulated IO with a timer.
+task<std::pair<ull, ull>> fetchRange(ThreadPool& pool, ull id) {
+   co_await pool.schedule();
+   co_await pool.sleep_for(std::chrono::milliseconds(5));
+   co_return std::make_pair(id * 1000000, (id + 1) * 1000000 - 1);
+}
+
+// Stage 2 : compute on the pool through a future.
+task<ull> processRange(ThreadPool& pool, ull id) {
+   auto range = co_await fetchRange(pool, id);
+   ull sum = co_await pool.submit([range] { return findOdd(range.first, range.second); });
+   co_return sum;
+}
+
+// Fire and await : submit a void callable.
+task<ull> countOnPool(ThreadPool& pool, ull n) {
+   std::atomic<ull> counter(0);
+   for (ull i = 0; i < n; ++i)
+       co_await pool.submit([&counter] { counter.fetch_add(1); });
+   co_return counter.load();
+}
+
+task<ull> pipeline(ThreadPool& pool, ull parts) {
+   co_await pool.schedule();
+   ull total = 0;
+   for (ull id = 0; id < parts; ++id)
+       total += co_await processRange(pool, id);
+   co_return total;
+}
+
+int main() {
+   ThreadPool pool(4);
+
+   auto t0 = std::chrono::steady_clock::now();
+   ull total = sync_wait(pipeline(pool, 20));
+   auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+   std::cout << "OddSum of [0, 2e7) : " << total << " (" << ms << " ms, 20 timer waits of 5 ms)\n";
+   std::cout << "Expected           : " << findOdd(0, 20000000 - 1) << "\n";
+   std::cout << "void submits awaited : " << sync_wait(countOnPool(pool, 100)) << "\n";
+
+   // Second round : frames are reused from the free lists.
+   size_t fresh = FramePool::fresh.load(), reused = FramePool::reused.load();
+   sync_wait(pipeline(pool, 20));
+   std::cout << "Frames round 2 : fresh " << FramePool::fresh.load() - fresh
+             << ", reused " << FramePool::reused.load() - reused
+             << ", oversized " << FramePool::oversized.load() << "\n";
+   return 0;
+}
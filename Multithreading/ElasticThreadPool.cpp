@@ -0,0 +1,263 @@
+//****** Elastic Thread Pool ******//
+
+//NOTES :
+//1. ThreadPool(size_t numThreads) in ThreadPool.cpp keeps the same number of workers for its
+//   whole life : too few for a burst, too many (sleeping, holding stacks) when idle.
+//2. ElasticThreadPool grows and shrinks between minThreads and maxThreads :
+//   a. SPAWN  : when no worker is free and either the queue is deeper than spawnQueueDepth or
+//               the oldest task has waited longer than spawnWaitTime. The wait time is also checked
+//               by a monitor thread every spawnWaitTime while tasks are queued, so a queue stuck
+//               behind long running tasks grows the pool even if nothing new is enqueued.
+//   b. RETIRE : a worker that stayed parked for idleTimeout exits, as long as more than
+//               minThreads are alive.
+//3. Spin before park : a worker that finds the queue empty first spins for spinTime watching an
+//   atomic counter. Bursty loads are then picked up without a condition variable wake up, and
+//   enqueue only calls notify_one when some worker is really parked.
+//4. A retiring thread can't join itself, it moves its std::thread handle to `retiredThreads`,
+//   which is joined on the next spawn or in the destructor.
+//5. stats() reports live/peak threads and spawn/retire counts.
+
+//Compile : g++ -std=c++17 -O2 -pthread ElasticThreadPool.cpp
+
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <list>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+struct ElasticPoolConfig {
+   using Clock = std::chrono::steady_clock;
+
+   size_t minThreads = 1;
+   size_t maxThreads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 4;
+   size_t spawnQueueDepth = 4;
+   Clock::duration spawnWaitTime = std::chrono::milliseconds(5);
+   Clock::duration idleTimeout = std::chrono::seconds(2);
+   Clock::duration spinTime = std::chrono::microseconds(50);
+};
+
+class ElasticThreadPool {
+public:
+   using Clock = std::chrono::steady_clock;
+   using Config = ElasticPoolConfig;
+
+   struct Stats {
+       size_t liveThreads;
+       size_t peakThreads;
+       size_t spawned;
+       size_t retired;
+       size_t queued;
+   };
+
+   explicit ElasticThreadPool(Config config = Config()) : config(config) {
+       if (this->config.maxThreads < this->config.minThreads)
+           this->config.maxThreads = this->config.minThreads;
+       std::lock_guard<std::mutex> lock(queueMutex);
+       for (size_t i = 0; i < this->config.minThreads; ++i)
+           spawnLocked();
+       monitor = std::thread([this] { monitorLoop(); });
+   }
+
+   template<class F>
+   void enqueue(F&& task) {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       tasks.push(Entry{ std::forward<F>(task), Clock::now() });
+       queuedCount.store(tasks.size(), std::memory_order_release);
+       maybeSpawnLocked();
+       bool wake = parked > 0;
+       bool wakeMonitor = monitorIdle && tasks.size() == 1; // Only on empty -> non-empty.
+       lock.unlock();
+       if (wake)
+           condition.notify_one();
+       if (wakeMonitor)
+           monitorCondition.notify_one();
+   }
+
+   Stats stats() {
+       std::lock_guard<std::mutex> lock(queueMutex);
+       return Stats{ live, peak, spawned, retired, tasks.size() };
+   }
+
+   ~ElasticThreadPool() {
+       std::vector<std::thread> all;
+       {
+           std::lock_guard<std::mutex> lock(queueMutex);
+           stop = true;
+           for (auto& t : threads)
+               all.push_back(std::move(t));
+           for (auto& t : retiredThreads)
+               all.push_back(std::move(t));
+       }
+       condition.notify_all();
+       monitorCondition.notify_one();
+       monitor.join();
+       for (std::thread& worker : all)
+           worker.join();
+   }
+
+private:
+   struct Entry {
+       std::function<void()> fn;
+       Clock::time_point enqueued;
+   };
+
+   // Called with queueMutex held.
+   void maybeSpawnLocked() {
+       if (stop || live >= config.maxThreads || live - busy > 0)
+           return; // Somebody is free (spinning or parked) and will take the task.
+       bool deep = tasks.size() >= config.spawnQueueDepth;
+       bool late = !tasks.empty() && Clock::now() - tasks.front().enqueued >= config.spawnWaitTime;
+       if (deep || late)
+           spawnLocked();
+   }
+
+   // Re-checks the wait time while tasks are queued, sleeps while the queue is empty.
+   void monitorLoop() {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       while (!stop) {
+           if (tasks.empty()) {
+               monitorIdle = true;
+               monitorCondition.wait(lock, [this] { return stop || !tasks.empty(); });
+               monitorIdle = false;
+               continue;
+           }
+           monitorCondition.wait_for(lock, config.spawnWaitTime, [this] { return stop; });
+           maybeSpawnLocked();
+       }
+   }
+
+   // Called with queueMutex held.
+   void spawnLocked() {
+       for (auto& t : retiredThreads)
+           t.join(); // Already finished, joining is instant.
+       retiredThreads.clear();
+
+       threads.emplace_back();
+       auto self = std::prev(threads.end());
+       ++live;
+       ++spawned;
+       if (live > peak)
+           peak = live;
+       *self = std::thread([this, self] { workerLoop(self); });
+   }
+
+   void workerLoop(std::list<std::thread>::iterator self) {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       for (;;) {
+           if (!tasks.empty()) {
+               auto task = std::move(tasks.front().fn);
+               tasks.pop();
+               queuedCount.store(tasks.size(), std::memory_order_release);
+               ++busy;
+               maybeSpawnLocked(); // The rest of the queue may still be waiting too long.
+               lock.unlock();
+               task();
+               task = nullptr;
+               lock.lock();
+               --busy;
+               continue;
+           }
+           if (stop)
+               return;
+
+           // Spin phase : watch the counter without holding the lock.
+           lock.unlock();
+           auto spinEnd = Clock::now() + config.spinTime;
+           while (queuedCount.load(std::memory_order_acquire) == 0 && Clock::now() < spinEnd)
+               std::this_thread::yield();
+           lock.lock();
+           if (!tasks.empty() || stop)
+               continue;
+
+           // Park phase.
+           ++parked;
+           bool woke = condition.wait_for(lock, config.idleTimeout, [this] { return stop || !tasks.empty(); });
+           --parked;
+           if (!woke && live > config.minThreads) {
+               --live;
+               ++retired;
+               retiredThreads.push_back(std::move(*self));
+               threads.erase(self);
+               return;
+           }
+       }
+   }
+
+   Config config;
+   std::list<std::thread> threads;          // std::list so a worker can keep an iterator to itself.
+   std::vector<std::thread> retiredThreads; // Finished workers waiting to be joined.
+   std::queue<Entry> tasks;
+   std::atomic<size_t> queuedCount{ 0 };    // Mirrors tasks.size() for the spinning workers.
+
+   std::mutex queueMutex;
+   std::condition_variable condition;
+   std::condition_variable monitorCondition;
+   std::thread monitor;
+   bool monitorIdle = false;
+   bool stop = false;
+
+   // Guarded by queueMutex.
+   size_t live = 0;
+   size_t busy = 0;
+   size_t parked = 0;
+   size_t peak = 0;
+   size_t spawned = 0;
+   size_t retired = 0;
+};
+
+void printStats(const char* when, ElasticThreadPool& pool) {
+   auto s = pool.stats();
+   printf("%-24s live %2zu  peak %2zu  spawned %2zu  retired %2zu  queued %3zu\n",
+          when, s.liveThreads, s.peakThreads, s.spawned, s.retired, s.queued);
+}
+
+int main() {
+   ElasticThreadPool::Config config;
+   config.minThreads = 2;
+   config.maxThreads = 16;
+   config.idleTimeout = std::chrono::milliseconds(200);
+   ElasticThreadPool pool(config);
+
+   printStats("start", pool);
+
+   // Burst : 100 tasks of 10 ms each.
+   std::atomic<int> done(0);
+   for (int i = 0; i < 100; ++i) {
+       pool.enqueue([&done] {
+           std::this_thread::sleep_for(std::chrono::milliseconds(10));
+           done.fetch_add(1);
+       });
+   }
+   printStats("after burst enqueue", pool);
+
+   while (done.load() < 100)
+       std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   printStats("burst finished", pool);
+
+   // Idle : extra workers retire after idleTimeout, back to minThreads.
+   std::this_thread::sleep_for(std::chrono::milliseconds(500));
+   printStats("after idle timeout", pool);
+
+   // Stuck : every worker is in a long task and one more task is queued, nothing else arrives.
+   // The monitor notices the wait time and spawns a worker for it.
+   std::atomic<bool> started(false);
+   for (size_t i = 0; i < config.minThreads; ++i)
+       pool.enqueue([] { std::this_thread::sleep_for(std::chrono::milliseconds(300)); });
+   std::this_thread::sleep_for(std::chrono::milliseconds(20)); // Let the workers take them.
+   auto queued = ElasticThreadPool::Clock::now();
+   std::atomic<long long> waitedUs(0);
+   pool.enqueue([&started, &waitedUs, queued] {
+       waitedUs = std::chrono::duration_cast<std::chrono::microseconds>(ElasticThreadPool::Clock::now() - queued).count();
+       started = true;
+   });
+   while (!started.load())
+       std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   printf("queued behind long tasks : started after %lld us\n", waitedUs.load());
+   printStats("after stuck queue", pool);
+   return 0;
+}
@@ -0,0 +1,352 @@
+//****** Thread Pool with allocation free task storage ******//
+
+//NOTES :
+//1. ThreadPool.cpp stores tasks as std::function<void()>. std::function only has a small
+//   internal buffer (16 bytes in libstdc++), so a lambda with a few captures goes to the heap.
+//   With many tiny tasks the pool ends up waiting on malloc/free.
+//2. Task (below) is a MOVE ONLY replacement :
+//   a. Inline buffer of Task::InlineSize bytes -> most lambdas live directly inside the Task.
+//   b. Bigger lambdas (up to SlabAllocator::BlockSize) go into a block from a slab free list.
+//      Slabs are allocated once and blocks are reused forever, so no malloc in steady state.
+//   c. Only lambdas larger than a slab block fall back to operator new.
+//3. std::queue (std::deque) also mallocs/frees chunks while it grows and shrinks, so the pool
+//   uses a ring buffer that only ever grows.
+//4. Allocation counters : global operator new is replaced in this file to count calls, and the
+//   Task keeps counts of inline / slab / heap stored tasks. main() prints mallocs per task.
+
+//Compile : g++ -std=c++17 -O2 -pthread InplaceTaskThreadPool.cpp
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+#include <array>
+
+//====== Allocation counters ======//
+
+std::atomic<size_t> g_mallocCount(0);
+
+void* operator new(size_t size) {
+   g_mallocCount.fetch_add(1, std::memory_order_relaxed);
+   if (void* p = std::malloc(size ? size : 1))
+       return p;
+   throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+struct TaskStats {
+   std::atomic<size_t> inlineStored{ 0 };
+   std::atomic<size_t> slabStored{ 0 };
+   std::atomic<size_t> heapStored{ 0 };
+};
+
+TaskStats g_taskStats;
+
+//====== Slab allocator for spilled tasks ======//
+
+class SlabAllocator {
+public:
+   static constexpr size_t BlockSize = 256;
+   static constexpr size_t BlocksPerSlab = 256;
+
+   static SlabAllocator& instance() {
+       static SlabAllocator slab;
+       return slab;
+   }
+
+   void* allocate() {
+       SpinLock lock(busy);
+       if (!freeList)
+           grow();
+       Block* b = freeList;
+       freeList = b->next;
+       return b;
+   }
+
+   void deallocate(void* p) {
+       SpinLock lock(busy);
+       Block* b = static_cast<Block*>(p);
+       b->next = freeList;
+       freeList = b;
+   }
+
+   ~SlabAllocator() {
+       for (Block* slab : slabs)
+           ::operator delete[](slab, std::align_val_t(alignof(std::max_align_t)));
+   }
+
+private:
+   union Block {
+       Block* next;
+       alignas(std::max_align_t) unsigned char bytes[BlockSize];
+   };
+
+   struct SpinLock {
+       std::atomic_flag& flag;
+       explicit SpinLock(std::atomic_flag& f) : flag(f) {
+           while (flag.test_and_set(std::memory_order_acquire))
+               std::this_thread::yield();
+       }
+       ~SpinLock() { flag.clear(std::memory_order_release); }
+   };
+
+   // Called with the spin lock held. Only happens while the pool warms up.
+   void grow() {
+       Block* slab = static_cast<Block*>(::operator new[](sizeof(Block) * BlocksPerSlab,
+                                                          std::align_val_t(alignof(std::max_align_t))));
+       slabs.push_back(slab);
+       for (size_t i = 0; i < BlocksPerSlab; ++i) {
+           slab[i].next = freeList;
+           freeList = &slab[i];
+       }
+   }
+
+   std::atomic_flag busy = ATOMIC_FLAG_INIT;
+   Block* freeList = nullptr;
+   std::vector<Block*> slabs;
+};
+
+//====== Move only task ======//
+
+class Task {
+public:
+   static constexpr size_t InlineSize = 64;
+
+   Task() = default;
+
+   template<class F, class = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+   Task(F&& f) {
+       using Fn = std::decay_t<F>;
+       if constexpr (fitsInline<Fn>()) {
+           new (storage) Fn(std::forward<F>(f));
+           ops = &inlineOps<Fn>;
+           g_taskStats.inlineStored.fetch_add(1, std::memory_order_relaxed);
+       }
+       else if constexpr (sizeof(Fn) <= SlabAllocator::BlockSize && alignof(Fn) <= alignof(std::max_align_t)) {
+           void* block = SlabAllocator::instance().allocate();
+           heldPointer() = new (block) Fn(std::forward<F>(f));
+           ops = &slabOps<Fn>;
+           g_taskStats.slabStored.fetch_add(1, std::memory_order_relaxed);
+       }
+       else {
+           heldPointer() = new Fn(std::forward<F>(f));
+           ops = &heapOps<Fn>;
+           g_taskStats.heapStored.fetch_add(1, std::memory_order_relaxed);
+       }
+   }
+
+   Task(Task&& other) noexcept { moveFrom(other); }
+
+   Task& operator=(Task&& other) noexcept {
+       if (this != &other) {
+           reset();
+           moveFrom(other);
+       }
+       return *this;
+   }
+
+   Task(const Task&) = delete;
+   Task& operator=(const Task&) = delete;
+
+   ~Task() { reset(); }
+
+   explicit operator bool() const { return ops != nullptr; }
+
+   void operator()() { ops->invoke(storage); }
+
+   void reset() {
+       if (ops) {
+           ops->destroy(storage);
+           ops = nullptr;
+       }
+   }
+
+private:
+   struct Ops {
+       void (*invoke)(void* storage);
+       void (*relocate)(void* dst, void* src); // Move into dst and destroy src.
+       void (*destroy)(void* storage);
+   };
+
+   template<class Fn>
+   static constexpr bool fitsInline() {
+       return sizeof(Fn) <= InlineSize && alignof(Fn) <= alignof(std::max_align_t)
+           && std::is_nothrow_move_constructible_v<Fn>;
+   }
+
+   template<class Fn>
+   static constexpr Ops inlineOps = {
+       [](void* s) { (*static_cast<Fn*>(s))(); },
+       [](void* dst, void* src) {
+           new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+           static_cast<Fn*>(src)->~Fn();
+       },
+       [](void* s) { static_cast<Fn*>(s)->~Fn(); }
+   };
+
+   template<class Fn>
+   static constexpr Ops slabOps = {
+       [](void* s) { (**static_cast<Fn**>(s))(); },
+       [](void* dst, void* src) { *static_cast<Fn**>(dst) = *static_cast<Fn**>(src); },
+       [](void* s) {
+           Fn* fn = *static_cast<Fn**>(s);
+           fn->~Fn();
+           SlabAllocator::instance().deallocate(fn);
+       }
+   };
+
+   template<class Fn>
+   static constexpr Ops heapOps = {
+       [](void* s) { (**static_cast<Fn**>(s))(); },
+       [](void* dst, void* src) { *static_cast<Fn**>(dst) = *static_cast<Fn**>(src); },
+       [](void* s) { delete *static_cast<Fn**>(s); }
+   };
+
+   void*& heldPointer() { return *reinterpret_cast<void**>(storage); }
+
+   void moveFrom(Task& other) noexcept {
+       if (other.ops) {
+           other.ops->relocate(storage, other.storage);
+           ops = other.ops;
+           other.ops = nullptr;
+       }
+   }
+
+   alignas(std::max_align_t) unsigned char storage[InlineSize];
+   const Ops* ops = nullptr;
+};
+
+//====== Ring buffer queue (grows, never shrinks) ======//
+
+class TaskRing {
+public:
+   explicit TaskRing(size_t capacity = 1024) : slots(capacity) {}
+
+   bool empty() const { return count == 0; }
+
+   void push(Task&& task) {
+       if (count == slots.size())
+           grow();
+       slots[(head + count) % slots.size()] = std::move(task);
+       ++count;
+   }
+
+   Task pop() {
+       Task task = std::move(slots[head]);
+       head = (head + 1) % slots.size();
+       --count;
+       return task;
+   }
+
+private:
+   void grow() {
+       std::vector<Task> bigger(slots.size() * 2);
+       for (size_t i = 0; i < count; ++i)
+           bigger[i] = std::move(slots[(head + i) % slots.size()]);
+       slots.swap(bigger);
+       head = 0;
+   }
+
+   std::vector<Task> slots;
+   size_t head = 0;
+   size_t count = 0;
+};
+
+//====== Thread pool ======//
+
+class ThreadPool {
+public:
+   ThreadPool(size_t numThreads) : stop(false) {
+       for (size_t i = 0; i < numThreads; ++i) {
+           workers.emplace_back([this] {
+               for (;;) {
+                   std::unique_lock<std::mutex> lock(queueMutex);
+                   condition.wait(lock, [this] { return stop || !tasks.empty(); });
+                   if (stop && tasks.empty())
+                       return;
+                   Task task = tasks.pop();
+                   lock.unlock();
+                   task();
+               }
+               });
+       }
+   }
+
+   template<class F>
+   void enqueue(F&& task) {
+       Task t(std::forward<F>(task)); // Build the task outside the lock.
+       std::unique_lock<std::mutex> lock(queueMutex);
+       tasks.push(std::move(t));
+       lock.unlock();
+       condition.notify_one();
+   }
+
+   ~ThreadPool() {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       stop = true;
+       lock.unlock();
+       condition.notify_all();
+       for (std::thread& worker : workers)
+           worker.join();
+   }
+
+private:
+   std::vector<std::thread> workers;
+   TaskRing tasks;
+
+   std::mutex queueMutex;
+   std::condition_variable condition;
+   bool stop;
+};
+
+// Runs `count` tasks of the given capture size and prints how many mallocs they caused.
+template<size_t CaptureBytes>
+void measure(ThreadPool& pool, int count) {
+   std::atomic<int> done(0);
+   std::array<char, CaptureBytes> payload{};
+   payload[0] = 1;
+
+   auto run = [&] {
+       for (int i = 0; i < count; ++i)
+           pool.enqueue([&done, payload] { done.fetch_add(payload[0], std::memory_order_relaxed); });
+       while (done.load() < count)
+           std::this_thread::yield();
+       done = 0;
+   };
+
+   run(); // Warm up : queue and slabs reach their steady size here.
+
+   size_t mallocsBefore = g_mallocCount.load();
+   size_t inlineBefore = g_taskStats.inlineStored.load();
+   size_t slabBefore = g_taskStats.slabStored.load();
+   size_t heapBefore = g_taskStats.heapStored.load();
+   run();
+   size_t mallocs = g_mallocCount.load() - mallocsBefore;
+
+   printf("capture %4zu bytes : inline %6zu  slab %6zu  heap %6zu  mallocs/task %.4f\n",
+          CaptureBytes,
+          g_taskStats.inlineStored.load() - inlineBefore,
+          g_taskStats.slabStored.load() - slabBefore,
+          g_taskStats.heapStored.load() - heapBefore,
+          static_cast<double>(mallocs) / count);
+}
+
+int main() {
+   ThreadPool pool(4);
+   const int N = 100000;
+
+   measure<16>(pool, N);   // std::function would already be on the heap here.
+   measure<48>(pool, N);   // Still inline.
+   measure<200>(pool, N);  // Slab block.
+   measure<1024>(pool, N); // Too big for a slab block : heap fallback.
+   return 0;
+}
@@ -0,0 +1,339 @@
+//****** Lock-free bounded MPMC queue as ThreadPool backend ******//
+
+//NOTES :
+//1. ThreadPool.cpp and ProducerConsumerUsingMutex.cpp both push every item through one
+//   std::mutex + std::condition_variable. Every producer and every consumer serialises on it.
+//2. MPMCQueue<T> is a bounded multi-producer / multi-consumer ring buffer (Dmitry Vyukov's design):
+//   a. Capacity is a power of two, every slot carries a sequence number.
+//   b. Producer : claims a position with CAS on enqueuePos, writes the value, then publishes it
+//      by setting slot.sequence = pos + 1.
+//   c. Consumer : claims a position with CAS on dequeuePos once slot.sequence == pos + 1, moves the
+//      value out, then frees the slot for the next lap with slot.sequence = pos + capacity.
+//   d. No lock anywhere. try_push returns false when full, try_pop returns false when empty.
+//   e. Head, tail and every slot sit on their own cache line, so producers and consumers don't
+//      invalidate each other's lines.
+//3. ThreadPool takes a QueueBackend : Mutex (same as ThreadPool.cpp) or LockFree (MPMCQueue).
+//   With LockFree, idle workers spin shortly and then sleep on a condition variable, and enqueue
+//   only takes that lock when somebody is really asleep. enqueue yields while the queue is full.
+//4. main() runs a stress test (every item seen exactly once, per-producer order kept) and a
+//   throughput benchmark at several producer:consumer ratios.
+
+//Compile : g++ -std=c++17 -O2 -pthread LockFreeMPMCQueue.cpp
+
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <deque>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+
+template<class T>
+class MPMCQueue {
+public:
+   explicit MPMCQueue(size_t capacity) : mask(capacity - 1), cells(capacity) {
+       if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+           throw std::invalid_argument("MPMCQueue capacity must be a power of two");
+       for (size_t i = 0; i < capacity; ++i)
+           cells[i].sequence.store(i, std::memory_order_relaxed);
+   }
+
+   MPMCQueue(const MPMCQueue&) = delete;
+   MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+   template<class U>
+   bool try_push(U&& value) {
+       Cell* cell;
+       size_t pos = enqueuePos.load(std::memory_order_relaxed);
+       for (;;) {
+           cell = &cells[pos & mask];
+           size_t seq = cell->sequence.load(std::memory_order_acquire);
+           intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+           if (diff == 0) {
+               if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                   break;
+           }
+           else if (diff < 0) {
+               return false; // Slot still holds last lap's value : full.
+           }
+           else {
+               pos = enqueuePos.load(std::memory_order_relaxed);
+           }
+       }
+       cell->data = std::forward<U>(value);
+       cell->sequence.store(pos + 1, std::memory_order_release);
+       return true;
+   }
+
+   bool try_pop(T& value) {
+       Cell* cell;
+       size_t pos = dequeuePos.load(std::memory_order_relaxed);
+       for (;;) {
+           cell = &cells[pos & mask];
+           size_t seq = cell->sequence.load(std::memory_order_acquire);
+           intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+           if (diff == 0) {
+               if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                   break;
+           }
+           else if (diff < 0) {
+               return false; // Nothing published here yet : empty.
+           }
+           else {
+               pos = dequeuePos.load(std::memory_order_relaxed);
+           }
+       }
+       value = std::move(cell->data);
+       cell->data = T(); // Drop captures now instead of on the next lap.
+       cell->sequence.store(pos + mask + 1, std::memory_order_release);
+       return true;
+   }
+
+   size_t capacity() const { return mask + 1; }
+
+private:
+   struct alignas(64) Cell {
+       std::atomic<size_t> sequence;
+       T data;
+   };
+
+   const size_t mask;
+   std::vector<Cell> cells;
+   alignas(64) std::atomic<size_t> enqueuePos{ 0 };
+   alignas(64) std::atomic<size_t> dequeuePos{ 0 };
+};
+
+enum class QueueBackend { Mutex, LockFree };
+
+class ThreadPool {
+public:
+   ThreadPool(size_t numThreads, QueueBackend backend = QueueBackend::Mutex, size_t capacity = 1024)
+       : backend(backend), stop(false), ring(capacity), pending(0), sleepers(0) {
+       for (size_t i = 0; i < numThreads; ++i) {
+           if (backend == QueueBackend::Mutex)
+               workers.emplace_back([this] { mutexLoop(); });
+           else
+               workers.emplace_back([this] { lockFreeLoop(); });
+       }
+   }
+
+   template<class F>
+   void enqueue(F&& task) {
+       if (backend == QueueBackend::Mutex) {
+           std::unique_lock<std::mutex> lock(queueMutex);
+           tasks.emplace(std::forward<F>(task));
+           lock.unlock();
+           condition.notify_one();
+           return;
+       }
+
+       std::function<void()> fn(std::forward<F>(task));
+       pending.fetch_add(1);
+       while (!ring.try_push(std::move(fn)))
+           std::this_thread::yield(); // Full : let the workers catch up.
+       if (sleepers.load() != 0) {
+           { std::lock_guard<std::mutex> lock(queueMutex); }
+           condition.notify_one();
+       }
+   }
+
+   ~ThreadPool() {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       stop = true;
+       lock.unlock();
+       condition.notify_all();
+       for (std::thread& worker : workers)
+           worker.join();
+   }
+
+private:
+   void mutexLoop() {
+       for (;;) {
+           std::unique_lock<std::mutex> lock(queueMutex);
+           condition.wait(lock, [this] { return stop || !tasks.empty(); });
+           if (stop && tasks.empty())
+               return;
+           auto task = std::move(tasks.front());
+           tasks.pop();
+           lock.unlock();
+           task();
+       }
+   }
+
+   void lockFreeLoop() {
+       std::function<void()> task;
+       int idleSpins = 0;
+       for (;;) {
+           if (ring.try_pop(task)) {
+               pending.fetch_sub(1);
+               task();
+               task = nullptr;
+               idleSpins = 0;
+               continue;
+           }
+           if (++idleSpins < 64) { // Short spin first, parking costs a futex call on both sides.
+               std::this_thread::yield();
+               continue;
+           }
+           idleSpins = 0;
+           std::unique_lock<std::mutex> lock(queueMutex);
+           sleepers.fetch_add(1);
+           condition.wait(lock, [this] { return stop || pending.load() > 0; });
+           sleepers.fetch_sub(1);
+           if (stop && pending.load() == 0)
+               return;
+       }
+   }
+
+   QueueBackend backend;
+   std::vector<std::thread> workers;
+   std::queue<std::function<void()>> tasks;
+
+   std::mutex queueMutex;
+   std::condition_variable condition;
+   bool stop;
+
+   MPMCQueue<std::function<void()>> ring;
+   std::atomic<size_t> pending;  // Pushed but not yet popped (LockFree backend).
+   std::atomic<size_t> sleepers; // Workers parked on condition (LockFree backend).
+};
+
+//====== Mutex + condition_variable bounded queue, FIFO version of ProducerConsumerUsingMutex.cpp ======//
+
+template<class T>
+class MutexQueue {
+public:
+   explicit MutexQueue(size_t capacity) : capacity(capacity) {}
+
+   void push(T value) {
+       std::unique_lock<std::mutex> lock(mu);
+       notFull.wait(lock, [this] { return buffer.size() < capacity; });
+       buffer.push_back(std::move(value));
+       lock.unlock();
+       notEmpty.notify_one();
+   }
+
+   T pop() {
+       std::unique_lock<std::mutex> lock(mu);
+       notEmpty.wait(lock, [this] { return !buffer.empty(); });
+       T value = std::move(buffer.front());
+       buffer.pop_front();
+       lock.unlock();
+       notFull.notify_one();
+       return value;
+   }
+
+private:
+   std::mutex mu;
+   std::condition_variable notFull, notEmpty;
+   std::deque<T> buffer;
+   size_t capacity;
+};
+
+// Item = producer id in the high bits, sequence number in the low bits.
+inline uint64_t makeItem(uint64_t producer, uint64_t seq) { return (producer << 40) | seq; }
+
+bool stressTest(size_t producers, size_t consumers, uint64_t perProducer) {
+   MPMCQueue<uint64_t> queue(256);
+   std::vector<std::atomic<uint8_t>> seen(producers * perProducer);
+   std::atomic<uint64_t> consumed(0);
+   std::atomic<bool> orderBroken(false);
+   const uint64_t total = producers * perProducer;
+
+   std::vector<std::thread> threads;
+   for (size_t p = 0; p < producers; ++p) {
+       threads.emplace_back([&, p] {
+           for (uint64_t s = 0; s < perProducer; ++s)
+               while (!queue.try_push(makeItem(p, s)))
+                   std::this_thread::yield();
+       });
+   }
+   for (size_t c = 0; c < consumers; ++c) {
+       threads.emplace_back([&] {
+           std::vector<int64_t> last(producers, -1); // FIFO : each producer's items arrive in order.
+           uint64_t item;
+           while (consumed.load(std::memory_order_relaxed) < total) {
+               if (!queue.try_pop(item)) {
+                   std::this_thread::yield();
+                   continue;
+               }
+               uint64_t p = item >> 40, s = item & ((uint64_t(1) << 40) - 1);
+               if (static_cast<int64_t>(s) <= last[p])
+                   orderBroken = true;
+               last[p] = static_cast<int64_t>(s);
+               seen[p * perProducer + s].fetch_add(1, std::memory_order_relaxed);
+               consumed.fetch_add(1, std::memory_order_relaxed);
+           }
+       });
+   }
+   for (auto& t : threads)
+       t.join();
+
+   for (auto& s : seen)
+       if (s.load() != 1)
+           return false;
+   return !orderBroken.load();
+}
+
+template<class Push, class Pop>
+double itemsPerSecond(size_t producers, size_t consumers, uint64_t total, Push push, Pop pop) {
+   std::vector<std::thread> threads;
+   auto t0 = std::chrono::steady_clock::now();
+   for (size_t p = 0; p < producers; ++p) {
+       uint64_t count = total / producers + (p < total % producers ? 1 : 0);
+       threads.emplace_back([count, &push] { for (uint64_t i = 0; i < count; ++i) push(i); });
+   }
+   for (size_t c = 0; c < consumers; ++c) {
+       uint64_t count = total / consumers + (c < total % consumers ? 1 : 0);
+       threads.emplace_back([count, &pop] { for (uint64_t i = 0; i < count; ++i) pop(); });
+   }
+   for (auto& t : threads)
+       t.join();
+   std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - t0;
+   return total / elapsed.count();
+}
+
+int main() {
+   // 1. Stress test.
+   bool ok = stressTest(4, 4, 200000) && stressTest(1, 8, 200000) && stressTest(8, 1, 50000);
+   std::cout << "Stress test : " << (ok ? "PASSED" : "FAILED") << "\n\n";
+
+   // 2. Throughput at several producer:consumer ratios.
+   const uint64_t total = 1000000;
+   const size_t ratios[][2] = { { 1, 1 }, { 1, 4 }, { 4, 1 }, { 2, 2 }, { 4, 4 }, { 8, 8 } };
+   std::cout << "P:C    mutex+cv (items/s)   lock-free (items/s)\n";
+   for (auto& r : ratios) {
+       MutexQueue<uint64_t> mq(1024);
+       double m = itemsPerSecond(r[0], r[1], total,
+                                 [&mq](uint64_t v) { mq.push(v); },
+                                 [&mq] { mq.pop(); });
+
+       MPMCQueue<uint64_t> lq(1024);
+       double l = itemsPerSecond(r[0], r[1], total,
+                                 [&lq](uint64_t v) { while (!lq.try_push(v)) std::this_thread::yield(); },
+                                 [&lq] { uint64_t v; while (!lq.try_pop(v)) std::this_thread::yield(); });
+       printf("%zu:%-4zu %18.0f   %19.0f\n", r[0], r[1], m, l);
+   }
+
+   // 3. The same queue behind the ThreadPool.
+   for (QueueBackend backend : { QueueBackend::Mutex, QueueBackend::LockFree }) {
+       std::atomic<int> done(0);
+       const int N = 200000;
+       auto t0 = std::chrono::steady_clock::now();
+       {
+           ThreadPool pool(4, backend);
+           for (int i = 0; i < N; ++i)
+               pool.enqueue([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+       }
+       std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - t0;
+       printf("\nThreadPool %-8s backend : %.0f tasks/s (%d run)",
+              backend == QueueBackend::Mutex ? "Mutex" : "LockFree", N / elapsed.count(), done.load());
+   }
+   std::cout << std::endl;
+   return 0;
+}
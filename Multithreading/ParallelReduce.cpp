@@ -0,0 +1,156 @@
+//****** parallel_reduce : findOdd on every core ******//
+
+//NOTES :
+//1. findOdd in Async.cpp / FutureAndPromises.cpp adds the odd numbers of [0, 1.9e9] in ONE loop on
+//   ONE thread. Async.cpp even uses std::launch::deferred, so it runs on the main thread at get().
+//2. parallel_reduce(pool, first, last, identity, map, combine) :
+//   a. Splits [first, last) into a few chunks per worker (some slack for uneven cores).
+//   b. Each chunk computes  acc = combine(acc, map(i))  over its indices, starting from identity.
+//   c. The chunk results are combined in chunk order, so combine only needs to be associative.
+//3. Vectorizing the inner loop :
+//   a. `if (i & 1) OddSum += i;` is a branch per element. Written as a select,
+//      `i & 1 ? i : 0` (or the mask form i & -(i & 1)), the compiler can use SIMD compares/blends.
+//   b. map and combine are template parameters (not std::function), so they are inlined into the
+//      chunk loop and the whole loop can be auto-vectorized (-O2/-O3, check with -fopt-info-vec).
+//   c. The chunk loop runs over a local accumulator, no shared variable, no atomics.
+//4. main() compares the original findOdd with parallel_reduce for sizes from 1e6 to 2e9.
+
+//Compile : g++ -std=c++17 -O3 -march=native -pthread ParallelReduce.cpp
+
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+class ThreadPool {
+public:
+   ThreadPool(size_t numThreads) : stop(false) {
+       for (size_t i = 0; i < numThreads; ++i) {
+           workers.emplace_back([this] {
+               for (;;) {
+                   std::unique_lock<std::mutex> lock(queueMutex);
+                   condition.wait(lock, [this] { return stop || !tasks.empty(); });
+                   if (stop && tasks.empty())
+                       return;
+                   auto task = std::move(tasks.front());
+                   tasks.pop();
+                   lock.unlock();
+                   task();
+               }
+               });
+       }
+   }
+
+   template<class F>
+   void enqueue(F&& task) {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       tasks.emplace(std::forward<F>(task));
+       lock.unlock();
+       condition.notify_one();
+   }
+
+   size_t size() const { return workers.size(); }
+
+   ~ThreadPool() {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       stop = true;
+       lock.unlock();
+       condition.notify_all();
+       for (std::thread& worker : workers)
+           worker.join();
+   }
+
+private:
+   std::vector<std::thread> workers;
+   std::queue<std::function<void()>> tasks;
+
+   std::mutex queueMutex;
+   std::condition_variable condition;
+   bool stop;
+};
+
+// Reduces [first, last) sequentially. Kept separate so the compiler sees a plain counted loop.
+template<class Index, class T, class Map, class Combine>
+T reduceChunk(Index first, Index last, T acc, const Map& map, const Combine& combine) {
+   for (Index i = first; i < last; ++i)
+       acc = combine(acc, map(i));
+   return acc;
+}
+
+// Blocks the caller until the result is ready, call it from outside the pool.
+template<class Index, class T, class Map, class Combine>
+T parallel_reduce(ThreadPool& pool, Index first, Index last, T identity, Map map, Combine combine) {
+   if (first >= last)
+       return identity;
+   Index count = last - first;
+   Index chunks = static_cast<Index>(std::max<size_t>(1, pool.size() * 4));
+   if (chunks > count)
+       chunks = count;
+   Index step = count / chunks, extra = count % chunks;
+
+   std::vector<T> partial(static_cast<size_t>(chunks), identity);
+   std::mutex m;
+   std::condition_variable cv;
+   Index remaining = chunks;
+
+   Index lo = first;
+   for (Index c = 0; c < chunks; ++c) {
+       Index hi = lo + step + (c < extra ? 1 : 0);
+       pool.enqueue([&, c, lo, hi] {
+           T r = reduceChunk(lo, hi, identity, map, combine);
+           std::lock_guard<std::mutex> lock(m);
+           partial[static_cast<size_t>(c)] = r;
+           if (--remaining == 0)
+               cv.notify_one();
+       });
+       lo = hi;
+   }
+
+   std::unique_lock<std::mutex> lock(m);
+   cv.wait(lock, [&] { return remaining == 0; });
+   T result = identity;
+   for (const T& p : partial)
+       result = combine(result, p);
+   return result;
+}
+
+typedef long int ull;
+
+// The original, from Async.cpp (without the thread id print).
+ull findOdd(ull start, ull end) {
+   ull OddSum = 0;
+   for (ull i = start; i <= end; ++i) {
+       if (i & 1) {
+           OddSum += i;
+       }
+   }
+   return OddSum;
+}
+
+int main() {
+   size_t cores = std::max(1u, std::thread::hardware_concurrency());
+   ThreadPool pool(cores);
+
+   std::cout << "Workers : " << cores << "\n";
+   std::cout << "      size        findOdd (ms)   parallel_reduce (ms)   result\n";
+   for (ull size : { 1000000L, 10000000L, 100000000L, 1000000000L, 1900000000L, 2000000000L }) {
+       auto t0 = std::chrono::steady_clock::now();
+       ull expected = findOdd(0, size - 1);
+       auto t1 = std::chrono::steady_clock::now();
+       ull sum = parallel_reduce(pool, ull(0), size, ull(0),
+                                 [](ull i) { return (i & 1) ? i : ull(0); }, // Select, not a branch.
+                                 [](ull a, ull b) { return a + b; });
+       auto t2 = std::chrono::steady_clock::now();
+
+       auto ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+       printf("%10ld   %14.1f   %20.1f   %s\n", size, ms(t1 - t0), ms(t2 - t1),
+              sum == expected ? "match" : "MISMATCH");
+   }
+   return 0;
+}
@@ -0,0 +1,414 @@
+//****** Multi-stage Pipeline (generalized Producer/Consumer) ******//
+
+//NOTES :
+//1. Chaining producer/consumer stages by hand means one mutex + condition_variable + deque per link
+//   (ProducerConsumerUsingMutex.cpp), hand-written close/stop logic, and no idea which stage is slow.
+//2. Typed builder :
+//      auto p = Pipeline::source("read", gen)               // gen() -> std::optional<T>, nullopt = end
+//                   .stage("parse", fn, parallelism, order) // fn(T) -> U, any number of stages
+//                   .sink("write", fn, parallelism, order); // fn(U)
+//      p.run();                                             // blocks until everything went through
+//   The types are checked at compile time : stage() returns a builder of fn's result type.
+//3. Between two stages there is a BoundedQueue (capacity set in source()). A full queue blocks the
+//   stage in front of it : back-pressure, memory stays bounded however slow the last stage is.
+//   When the last worker of a stage finishes it closes its output queue, and so on down the line.
+//4. Order :
+//   a. Unordered -> a worker pushes its result as soon as it is done. Fastest. The output queue
+//                   numbers items again in the order they are pushed.
+//   b. Ordered   -> every item carries its sequence number, results go through a reorder buffer
+//                   and leave the stage in the order they came in. The buffer is bounded : a worker
+//                   waits before processing an item that is `queueCapacity` or more ahead of the next
+//                   one to leave. One worker at a time moves the ready items downstream, outside the
+//                   reorder lock, so a full output queue blocks that worker only.
+//5. Metrics per stage (as a share of workers x wall time) :
+//   a. busy    -> time inside fn.
+//   b. starved -> waiting on an empty input queue (upstream is too slow).
+//   c. blocked -> waiting on a full output queue (downstream is too slow).
+//   The bottleneck is the stage with the highest busy share : stages before it are blocked,
+//   stages after it are starved. Give it more parallelism.
+
+//Compile : g++ -std=c++17 -O2 -pthread Pipeline.cpp
+
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <map>
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <optional>
+#include <functional>
+#include <type_traits>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+using Clock = std::chrono::steady_clock;
+
+inline uint64_t elapsedNs(Clock::time_point since) {
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - since).count();
+}
+
+enum class Order { Unordered, Ordered };
+
+template<class T>
+struct Item {
+   uint64_t seq;
+   T value;
+};
+
+template<class T>
+class BoundedQueue {
+public:
+   explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+   // Blocks while full, the time spent waiting is added to blockedNs.
+   // renumber : value.seq becomes the push order (the output of an unordered stage).
+   void push(T value, uint64_t& blockedNs, bool renumber = false) {
+       std::unique_lock<std::mutex> locker(mu);
+       if (buffer.size() >= capacity) {
+           auto t0 = Clock::now();
+           notFull.wait(locker, [this] { return buffer.size() < capacity; });
+           blockedNs += elapsedNs(t0);
+       }
+       if (renumber)
+           value.seq = pushed++;
+       buffer.push_back(std::move(value));
+       locker.unlock();
+       notEmpty.notify_one();
+   }
+
+   // Blocks while empty, the time spent waiting is added to starvedNs. false : closed and drained.
+   bool pop(T& out, uint64_t& starvedNs) {
+       std::unique_lock<std::mutex> locker(mu);
+       if (buffer.empty() && !closed) {
+           auto t0 = Clock::now();
+           notEmpty.wait(locker, [this] { return closed || !buffer.empty(); });
+           starvedNs += elapsedNs(t0);
+       }
+       if (buffer.empty())
+           return false;
+       out = std::move(buffer.front());
+       buffer.pop_front();
+       locker.unlock();
+       notFull.notify_one();
+       return true;
+   }
+
+   void close() {
+       {
+           std::lock_guard<std::mutex> locker(mu);
+           closed = true;
+       }
+       notEmpty.notify_all();
+   }
+
+private:
+   std::mutex mu;
+   std::condition_variable notEmpty, notFull;
+   std::deque<T> buffer;
+   const size_t capacity;
+   uint64_t pushed = 0;
+   bool closed = false;
+};
+
+// Hands values to `out` in sequence order, whatever order they arrive in. Sequence numbers come
+// in order from the input queue, so holding back the ones `window` or more ahead of the next one
+// to leave bounds the buffer and can't deadlock : that next one is already in a worker's hands.
+template<class T>
+class Reorderer {
+public:
+   explicit Reorderer(size_t window) : window(std::max<size_t>(1, window)) {}
+
+   // Before processing item `seq` : waits while it is too far ahead, the wait is added to blockedNs.
+   void admit(uint64_t seq, uint64_t& blockedNs) {
+       std::unique_lock<std::mutex> locker(mu);
+       if (seq - next >= window) {
+           auto t0 = Clock::now();
+           advanced.wait(locker, [this, seq] { return seq - next < window; });
+           blockedNs += elapsedNs(t0);
+       }
+   }
+
+   // One thread at a time (the drainer) calls out, without the lock. Others just leave their value.
+   template<class Out>
+   void emit(uint64_t seq, T value, Out&& out) {
+       std::unique_lock<std::mutex> locker(mu);
+       pending.emplace(seq, std::move(value));
+       if (draining)
+           return; // The drainer picks it up on its next round.
+       draining = true;
+       std::vector<std::pair<uint64_t, T>> ready;
+       while (true) {
+           while (!pending.empty() && pending.begin()->first == next) {
+               ready.emplace_back(next, std::move(pending.begin()->second));
+               pending.erase(pending.begin());
+               ++next;
+           }
+           if (ready.empty()) {
+               draining = false;
+               return;
+           }
+           locker.unlock();
+           advanced.notify_all();
+           for (auto& r : ready)
+               out(r.first, std::move(r.second));
+           ready.clear();
+           locker.lock();
+       }
+   }
+
+private:
+   std::mutex mu;
+   std::condition_variable advanced;
+   std::map<uint64_t, T> pending;
+   const size_t window;
+   uint64_t next = 0;
+   bool draining = false;
+};
+
+struct StageMetrics {
+   std::string name;
+   size_t parallelism = 1;
+   std::atomic<uint64_t> items{ 0 }, busyNs{ 0 }, starvedNs{ 0 }, blockedNs{ 0 };
+
+   // Workers count locally and add once when they finish.
+   void add(uint64_t n, uint64_t busy, uint64_t starved, uint64_t blocked) {
+       items += n;
+       busyNs += busy;
+       starvedNs += starved;
+       blockedNs += blocked;
+   }
+};
+
+template<class T>
+class PipelineBuilder;
+
+class Pipeline {
+public:
+   template<class Gen>
+   static auto source(std::string name, Gen gen, size_t queueCapacity = 64) {
+       using T = typename std::invoke_result_t<Gen&>::value_type;
+       auto pipeline = std::unique_ptr<Pipeline>(new Pipeline(queueCapacity));
+       StageMetrics* m = pipeline->addStage(std::move(name), 1);
+       auto out = std::make_shared<BoundedQueue<Item<T>>>(queueCapacity);
+
+       pipeline->workers.push_back([gen = std::move(gen), out, m]() mutable {
+           uint64_t seq = 0, busy = 0, blocked = 0;
+           while (true) {
+               auto t0 = Clock::now();
+               std::optional<T> v = gen();
+               busy += elapsedNs(t0);
+               if (!v)
+                   break;
+               out->push(Item<T>{ seq++, std::move(*v) }, blocked);
+           }
+           m->add(seq, busy, 0, blocked);
+           out->close();
+       });
+       return PipelineBuilder<T>(std::move(pipeline), std::move(out));
+   }
+
+   // Runs every stage and blocks until the sink has seen the last item. Call it once.
+   void run() {
+       auto t0 = Clock::now();
+       std::vector<std::thread> threads;
+       for (auto& w : workers)
+           threads.emplace_back(w);
+       for (auto& t : threads)
+           t.join();
+       wallNs = elapsedNs(t0);
+   }
+
+   void print_metrics() const {
+       double wallSec = wallNs / 1e9;
+       printf("  %-8s %3s %9s %11s %7s %8s %8s\n", "stage", "par", "items", "items/s", "busy", "starved", "blocked");
+       const StageMetrics* bottleneck = nullptr;
+       double worst = -1;
+       for (auto& s : stages) {
+           double capacityNs = double(wallNs) * s->parallelism;
+           double busy = s->busyNs / capacityNs;
+           printf("  %-8s %3zu %9llu %11.0f %6.1f%% %7.1f%% %7.1f%%\n", s->name.c_str(), s->parallelism,
+                  static_cast<unsigned long long>(s->items.load()), s->items / wallSec, 100 * busy,
+                  100 * s->starvedNs / capacityNs, 100 * s->blockedNs / capacityNs);
+           if (busy > worst) {
+               worst = busy;
+               bottleneck = s.get();
+           }
+       }
+       printf("  wall %.1f ms, bottleneck : %s\n", wallNs / 1e6, bottleneck ? bottleneck->name.c_str() : "-");
+   }
+
+private:
+   template<class T>
+   friend class PipelineBuilder;
+
+   explicit Pipeline(size_t queueCapacity) : queueCapacity(queueCapacity) {}
+
+   StageMetrics* addStage(std::string name, size_t parallelism) {
+       stages.push_back(std::make_unique<StageMetrics>());
+       stages.back()->name = std::move(name);
+       stages.back()->parallelism = parallelism;
+       return stages.back().get();
+   }
+
+   size_t queueCapacity;
+   std::vector<std::unique_ptr<StageMetrics>> stages; // unique_ptr : workers keep pointers to them.
+   std::vector<std::function<void()>> workers;
+   uint64_t wallNs = 0;
+};
+
+template<class T>
+class PipelineBuilder {
+public:
+   PipelineBuilder(std::unique_ptr<Pipeline> pipeline, std::shared_ptr<BoundedQueue<Item<T>>> input)
+       : pipeline(std::move(pipeline)), input(std::move(input)) {}
+
+   template<class F>
+   auto stage(std::string name, F fn, size_t parallelism = 1, Order order = Order::Ordered) {
+       using U = std::invoke_result_t<F&, T>;
+       static_assert(!std::is_void_v<U>, "a stage must return a value, use sink() for the last step");
+       parallelism = std::max<size_t>(1, parallelism);
+       StageMetrics* m = pipeline->addStage(std::move(name), parallelism);
+       auto out = std::make_shared<BoundedQueue<Item<U>>>(pipeline->queueCapacity);
+       auto shared = std::make_shared<Shared<U, F>>(std::move(fn), parallelism, pipeline->queueCapacity);
+
+       for (size_t w = 0; w < parallelism; ++w) {
+           pipeline->workers.push_back([in = input, out, shared, m, order] {
+               uint64_t items = 0, busy = 0, starved = 0, blocked = 0;
+               Item<T> item;
+               while (in->pop(item, starved)) {
+                   if (order == Order::Ordered)
+                       shared->reorder.admit(item.seq, blocked);
+                   auto t0 = Clock::now();
+                   U result = shared->fn(std::move(item.value));
+                   busy += elapsedNs(t0);
+                   ++items;
+                   if (order == Order::Ordered)
+                       shared->reorder.emit(item.seq, std::move(result), [&](uint64_t seq, U&& v) {
+                           out->push(Item<U>{ seq, std::move(v) }, blocked);
+                       });
+                   else
+                       out->push(Item<U>{ 0, std::move(result) }, blocked, true);
+               }
+               m->add(items, busy, starved, blocked);
+               if (--shared->live == 0)
+                   out->close();
+           });
+       }
+       return PipelineBuilder<U>(std::move(pipeline), std::move(out));
+   }
+
+   // With Order::Ordered, fn sees the items in input order, source order if no stage before is
+   // unordered (calls are serialized).
+   template<class F>
+   Pipeline sink(std::string name, F fn, size_t parallelism = 1, Order order = Order::Ordered) {
+       parallelism = std::max<size_t>(1, parallelism);
+       StageMetrics* m = pipeline->addStage(std::move(name), parallelism);
+       auto shared = std::make_shared<Shared<T, F>>(std::move(fn), parallelism, pipeline->queueCapacity);
+
+       for (size_t w = 0; w < parallelism; ++w) {
+           pipeline->workers.push_back([in = input, shared, m, order] {
+               uint64_t items = 0, busy = 0, starved = 0, blocked = 0;
+               Item<T> item;
+               auto consume = [&](uint64_t, T&& v) {
+                   auto t0 = Clock::now();
+                   shared->fn(std::move(v));
+                   busy += elapsedNs(t0);
+                   ++items;
+               };
+               while (in->pop(item, starved)) {
+                   if (order == Order::Ordered) {
+                       shared->reorder.admit(item.seq, blocked);
+                       shared->reorder.emit(item.seq, std::move(item.value), consume);
+                   }
+                   else {
+                       consume(item.seq, std::move(item.value));
+                   }
+               }
+               m->add(items, busy, starved, blocked);
+           });
+       }
+       return std::move(*pipeline);
+   }
+
+private:
+   // State shared by the workers of one stage.
+   template<class U, class F>
+   struct Shared {
+       Shared(F fn, size_t workers, size_t window) : fn(std::move(fn)), reorder(window), live(workers) {}
+       F fn;
+       Reorderer<U> reorder;
+       std::atomic<size_t> live;
+   };
+
+   std::unique_ptr<Pipeline> pipeline;
+   std::shared_ptr<BoundedQueue<Item<T>>> input;
+};
+
+//====== Demo : read -> parse -> fetch (I/O bound) -> write ======//
+
+struct Record {
+   int id;
+   std::string text;
+};
+
+void runDemo(size_t fetchParallelism, Order fetchOrder) {
+   const int N = 4000;
+   int next = 0, seen = 0;
+   bool inOrder = true;
+
+   Pipeline p = Pipeline::source("read", [&next]() -> std::optional<int> {
+                        if (next == N)
+                            return std::nullopt;
+                        return next++;
+                    })
+                    .stage("parse", [](int id) { return Record{ id, "record " + std::to_string(id) }; })
+                    .stage("fetch", [](Record r) {
+                        std::this_thread::sleep_for(std::chrono::microseconds(50)); // A remote lookup.
+                        r.text += " +details";
+                        return r;
+                    }, fetchParallelism, fetchOrder)
+                    .sink("write", [&](Record r) { inOrder &= (r.id == seen++); }, 1, fetchOrder);
+   p.run();
+
+   printf("fetch x%zu, %s : %s\n", fetchParallelism, fetchOrder == Order::Ordered ? "ordered" : "unordered",
+          seen != N ? "ITEMS LOST" : inOrder ? "all items, in order" : "all items, out of order");
+   p.print_metrics();
+}
+
+// Item 0 is slow and the stage is ordered : the others must wait, not pile up in the reorder buffer.
+void slowHeadCheck() {
+   const int N = 20000;
+   const size_t capacity = 64;
+   std::atomic<int> produced(0), consumed(0);
+   int maxInFlight = 0;
+
+   Pipeline p = Pipeline::source("read", [&]() -> std::optional<int> {
+                        int n = produced.load();
+                        if (n == N)
+                            return std::nullopt;
+                        maxInFlight = std::max(maxInFlight, n - consumed.load());
+                        produced.store(n + 1);
+                        return n;
+                    }, capacity)
+                    .stage("work", [](int id) {
+                        if (id == 0)
+                            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                        return id;
+                    }, 4, Order::Ordered)
+                    .sink("count", [&consumed](int) { consumed.fetch_add(1); });
+   p.run();
+   printf("slow first item, capacity %zu : at most %d items in flight (of %d)\n\n", capacity, maxInFlight, N);
+}
+
+int main() {
+   slowHeadCheck();
+   runDemo(1, Order::Ordered);  // fetch is the bottleneck, read and parse are blocked.
+   runDemo(8, Order::Ordered);
+   runDemo(8, Order::Unordered);
+   return 0;
+}
@@ -0,0 +1,226 @@
+//****** Thread Pool with priority lanes and deadlines ******//
+
+//NOTES :
+//1. ThreadPool.cpp has one FIFO std::queue, so a latency sensitive task waits behind every
+//   bulk job that was enqueued before it.
+//2. This pool has one lane per Priority (High, Normal, Low) :
+//   a. Workers always serve the highest non-empty lane first.
+//   b. Inside a lane tasks run Earliest Deadline First (EDF). A task without an explicit
+//      deadline gets "now + lane budget", so equal tasks in a lane stay FIFO.
+//3. Starvation protection (aging) : if the OLDEST task of a lower lane has waited longer than
+//   that lane's maxWait, it is served before the higher lanes. Each lane keeps a second index in
+//   arrival order, so an old task behind fresher, earlier deadlines is still found.
+//4. enqueue(task) still works and means Priority::Normal.
+//5. main() first checks aging (an old Low task behind earlier deadlines), then floods the pool
+//   with Low tasks and measures how long High tasks wait in the queue (enqueue -> start), once
+//   with priority lanes and once with everything in one FIFO lane.
+
+//Compile : g++ -std=c++17 -O2 -pthread PriorityThreadPool.cpp
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <array>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+enum class Priority { High = 0, Normal = 1, Low = 2 };
+
+class ThreadPool {
+public:
+   using Clock = std::chrono::steady_clock;
+
+   static constexpr size_t LaneCount = 3;
+
+   ThreadPool(size_t numThreads) : stop(false), sequence(0) {
+       laneBudget = { std::chrono::milliseconds(1), std::chrono::milliseconds(10), std::chrono::milliseconds(100) };
+       maxWait = { Clock::duration::max(), std::chrono::milliseconds(50), std::chrono::milliseconds(200) };
+       for (size_t i = 0; i < numThreads; ++i) {
+           workers.emplace_back([this] {
+               for (;;) {
+                   std::unique_lock<std::mutex> lock(queueMutex);
+                   condition.wait(lock, [this] { return stop || !allEmpty(); });
+                   if (stop && allEmpty())
+                       return;
+                   auto task = popNext();
+                   lock.unlock();
+                   task();
+               }
+               });
+       }
+   }
+
+   template<class F>
+   void enqueue(F&& task) {
+       enqueue(std::forward<F>(task), Priority::Normal);
+   }
+
+   template<class F>
+   void enqueue(F&& task, Priority priority) {
+       auto now = Clock::now();
+       push(std::forward<F>(task), priority, now, now + laneBudget[index(priority)]);
+   }
+
+   // EDF inside the lane : the earlier the deadline, the sooner it runs.
+   template<class F>
+   void enqueue_with_deadline(F&& task, Clock::time_point deadline, Priority priority = Priority::Normal) {
+       push(std::forward<F>(task), priority, Clock::now(), deadline);
+   }
+
+   ~ThreadPool() {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       stop = true;
+       lock.unlock();
+       condition.notify_all();
+       for (std::thread& worker : workers)
+           worker.join();
+   }
+
+private:
+   struct Entry {
+       std::function<void()> fn;
+       Clock::time_point enqueued;
+       Clock::time_point deadline;
+       uint64_t seq; // Tie breaker, keeps equal deadlines FIFO.
+   };
+
+   // byDeadline is the EDF order (seq keeps equal deadlines FIFO), byArrival maps seq -> deadline.
+   struct Lane {
+       std::map<std::pair<Clock::time_point, uint64_t>, Entry> byDeadline;
+       std::map<uint64_t, Clock::time_point> byArrival;
+
+       bool empty() const { return byArrival.empty(); }
+
+       void push(Entry e) {
+           byArrival.emplace(e.seq, e.deadline);
+           auto key = std::make_pair(e.deadline, e.seq);
+           byDeadline.emplace(key, std::move(e));
+       }
+
+       const Entry& oldest() const {
+           auto first = byArrival.begin();
+           return byDeadline.find({ first->second, first->first })->second;
+       }
+
+       std::function<void()> pop(const Entry& e) {
+           auto it = byDeadline.find({ e.deadline, e.seq });
+           byArrival.erase(e.seq);
+           auto fn = std::move(it->second.fn);
+           byDeadline.erase(it);
+           return fn;
+       }
+   };
+
+   static size_t index(Priority p) { return static_cast<size_t>(p); }
+
+   template<class F>
+   void push(F&& task, Priority priority, Clock::time_point now, Clock::time_point deadline) {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       lanes[index(priority)].push(Entry{ std::forward<F>(task), now, deadline, sequence++ });
+       lock.unlock();
+       condition.notify_one();
+   }
+
+   bool allEmpty() const {
+       return std::all_of(lanes.begin(), lanes.end(), [](const Lane& l) { return l.empty(); });
+   }
+
+   // Called with queueMutex held and at least one lane non-empty.
+   std::function<void()> popNext() {
+       auto now = Clock::now();
+
+       // Aging : the lowest starving lane goes first, so Low can't starve behind Normal either.
+       for (size_t l = LaneCount; l-- > 1;) {
+           if (!lanes[l].empty()) {
+               const Entry& oldest = lanes[l].oldest();
+               if (now - oldest.enqueued > maxWait[l])
+                   return lanes[l].pop(oldest);
+           }
+       }
+       for (size_t l = 0; l < LaneCount; ++l) {
+           if (!lanes[l].empty())
+               return lanes[l].pop(lanes[l].byDeadline.begin()->second);
+       }
+       return nullptr;
+   }
+
+   std::vector<std::thread> workers;
+   std::array<Lane, LaneCount> lanes;
+   std::array<Clock::duration, LaneCount> laneBudget;
+   std::array<Clock::duration, LaneCount> maxWait;
+
+   std::mutex queueMutex;
+   std::condition_variable condition;
+   bool stop;
+   uint64_t sequence;
+};
+
+void spinFor(std::chrono::microseconds d) {
+   auto end = std::chrono::steady_clock::now() + d;
+   while (std::chrono::steady_clock::now() < end) {}
+}
+
+// Keeps the pool saturated with Low work and samples the queueing delay of High tasks.
+void latencyBenchmark(const char* name, Priority highLane) {
+   using Clock = ThreadPool::Clock;
+   const size_t workers = 4, samples = 2000, backlog = 200;
+   std::vector<long long> delays(samples);
+   std::atomic<size_t> measured(0);
+   std::atomic<size_t> lowInFlight(0);
+   {
+       ThreadPool pool(workers);
+       for (size_t i = 0; i < samples; ++i) {
+           while (lowInFlight.load() < backlog) {
+               lowInFlight.fetch_add(1);
+               pool.enqueue([&lowInFlight] { spinFor(std::chrono::microseconds(50)); lowInFlight.fetch_sub(1); },
+                            Priority::Low);
+           }
+           auto queued = Clock::now();
+           pool.enqueue([&delays, &measured, queued, i] {
+               delays[i] = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - queued).count();
+               measured.fetch_add(1);
+           }, highLane);
+           std::this_thread::sleep_for(std::chrono::microseconds(200));
+       }
+       while (measured.load() < samples)
+           std::this_thread::yield();
+   }
+
+   std::sort(delays.begin(), delays.end());
+   auto pct = [&delays](double p) { return delays[std::min(delays.size() - 1, static_cast<size_t>(p * delays.size()))]; };
+   printf("%-22s p50 %8lld us   p99 %8lld us   p999 %8lld us\n", name, pct(0.50), pct(0.99), pct(0.999));
+}
+
+// One worker, blocked past Low's maxWait. The old Low task has a far deadline and fresh Low tasks
+// with earlier deadlines arrive just before the worker frees up : aging must still pick it first.
+void agingCheck() {
+   using Clock = ThreadPool::Clock;
+   std::vector<int> order;
+   std::mutex orderMutex;
+   auto record = [&order, &orderMutex](int id) {
+       return [&order, &orderMutex, id] { std::lock_guard<std::mutex> lock(orderMutex); order.push_back(id); };
+   };
+   {
+       ThreadPool pool(1);
+       pool.enqueue([] { std::this_thread::sleep_for(std::chrono::milliseconds(300)); }, Priority::High);
+       std::this_thread::sleep_for(std::chrono::milliseconds(10));
+       pool.enqueue_with_deadline(record(0), Clock::now() + std::chrono::hours(1), Priority::Low);
+       std::this_thread::sleep_for(std::chrono::milliseconds(250));
+       for (int i = 1; i <= 3; ++i)
+           pool.enqueue_with_deadline(record(i), Clock::now(), Priority::Low);
+   }
+   std::cout << "Aging : old Low task ran " << (order.size() == 4 && order[0] == 0 ? "first (ok)" : "late (FAILED)") << "\n";
+}
+
+int main() {
+   agingCheck();
+   latencyBenchmark("FIFO (all Low lane)", Priority::Low);
+   latencyBenchmark("High priority lane", Priority::High);
+   return 0;
+}
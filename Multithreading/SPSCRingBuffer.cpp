@@ -0,0 +1,219 @@
+//****** Lock-free SPSC Ring Buffer for Producer/Consumer ******//
+
+//NOTES :
+//1. ProducerConsumerUsingMutex.cpp moves ONE int per lock + unlock + notify through a deque of at
+//   most 50 items. Every item pays for the mutex, and both threads fight over it all the time.
+//2. With exactly ONE producer and ONE consumer we don't need a lock at all :
+//   a. A fixed ring of capacity 2^k (index & mask, no modulo).
+//   b. tail is written only by the producer, head only by the consumer. Each one just publishes
+//      its own index with a release store and reads the other one with an acquire load.
+//3. Cache lines :
+//   a. head and tail are alignas(64), on different cache lines, so the producer writing tail does
+//      not invalidate the line the consumer writes head into (false sharing).
+//   b. Cached remote index : the producer keeps a private copy of head and only reloads the real
+//      head when the ring LOOKS full. Same for the consumer with tail when it looks empty. Most
+//      push/pop calls touch no shared cache line except the slot itself.
+//4. WaitMode :
+//   a. Spin  -> push()/pop() retry (with yield) until they succeed. Lowest latency, burns a core.
+//   b. Block -> spin a little, then park on a condition_variable. The other side only takes the
+//      mutex to notify when it sees the waiting flag set, so the fast path stays lock-free.
+//5. main() moves 10M ints through the original mutex + deque buffer and through the ring, and
+//   checks that the consumer sees every value in FIFO order.
+
+//Compile : g++ -std=c++17 -O2 -pthread SPSCRingBuffer.cpp
+
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+enum class WaitMode { Spin, Block };
+
+template<class T>
+class SPSCRingBuffer {
+public:
+   // capacity is rounded up to a power of two.
+   explicit SPSCRingBuffer(size_t capacity, WaitMode mode = WaitMode::Block) : mode(mode) {
+       size_t cap = 2;
+       while (cap < capacity)
+           cap <<= 1;
+       mask = cap - 1;
+       slots.resize(cap);
+   }
+
+   SPSCRingBuffer(const SPSCRingBuffer&) = delete;
+   SPSCRingBuffer& operator=(const SPSCRingBuffer&) = delete;
+
+   size_t capacity() const { return mask + 1; }
+
+   // Producer thread only.
+   bool try_push(const T& value) {
+       size_t t = tail.load(std::memory_order_relaxed);
+       if (t - cachedHead > mask) {
+           cachedHead = head.load(std::memory_order_acquire);
+           if (t - cachedHead > mask)
+               return false;
+       }
+       slots[t & mask] = value;
+       tail.store(t + 1, std::memory_order_release);
+       wakeConsumer();
+       return true;
+   }
+
+   // Consumer thread only.
+   bool try_pop(T& out) {
+       size_t h = head.load(std::memory_order_relaxed);
+       if (h == cachedTail) {
+           cachedTail = tail.load(std::memory_order_acquire);
+           if (h == cachedTail)
+               return false;
+       }
+       out = std::move(slots[h & mask]);
+       head.store(h + 1, std::memory_order_release);
+       wakeProducer();
+       return true;
+   }
+
+   void push(const T& value) {
+       while (!try_push(value))
+           waitUntil(producerWaiting, notFull, [this] { return !full(); });
+   }
+
+   void pop(T& out) {
+       while (!try_pop(out))
+           waitUntil(consumerWaiting, notEmpty, [this] { return !empty(); });
+   }
+
+private:
+   bool full() const {
+       return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire) > mask;
+   }
+   bool empty() const {
+       return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+   }
+
+   template<class Ready>
+   void waitUntil(std::atomic<bool>& waiting, std::condition_variable& cv, Ready ready) {
+       for (int i = 0; i < 64; ++i) {
+           if (ready())
+               return;
+           std::this_thread::yield();
+       }
+       if (mode == WaitMode::Spin)
+           return;
+
+       // Announce, then re-check : the other side either sees the flag or we see its index.
+       waiting.store(true, std::memory_order_relaxed);
+       std::atomic_thread_fence(std::memory_order_seq_cst);
+       std::unique_lock<std::mutex> lock(parkMutex);
+       cv.wait(lock, ready);
+       waiting.store(false, std::memory_order_relaxed);
+   }
+
+   void wakeConsumer() {
+       if (mode == WaitMode::Block)
+           wake(consumerWaiting, notEmpty);
+   }
+   void wakeProducer() {
+       if (mode == WaitMode::Block)
+           wake(producerWaiting, notFull);
+   }
+
+   void wake(std::atomic<bool>& waiting, std::condition_variable& cv) {
+       std::atomic_thread_fence(std::memory_order_seq_cst); // Pairs with the fence in waitUntil.
+       if (!waiting.load(std::memory_order_relaxed))
+           return;
+       { std::lock_guard<std::mutex> lock(parkMutex); } // The waiter is either before its check or in wait().
+       cv.notify_one();
+   }
+
+   std::vector<T> slots;
+   size_t mask = 0;
+   WaitMode mode;
+
+   alignas(64) std::atomic<size_t> head{ 0 }; // Written by the consumer.
+   size_t cachedTail = 0;                      // Consumer's copy of tail.
+
+   alignas(64) std::atomic<size_t> tail{ 0 }; // Written by the producer.
+   size_t cachedHead = 0;                      // Producer's copy of head.
+
+   alignas(64) std::atomic<bool> consumerWaiting{ false };
+   std::atomic<bool> producerWaiting{ false };
+   std::mutex parkMutex;
+   std::condition_variable notEmpty, notFull;
+};
+
+//====== The original buffer (without cout, it would dominate the timing) ======//
+
+std::mutex mu;
+std::condition_variable cond;
+std::deque<int> buffer;
+const unsigned int maxBufferSize = 50;
+
+void dequeProducer(int count) {
+   for (int val = 0; val < count; ++val) {
+       std::unique_lock<std::mutex> locker(mu);
+       cond.wait(locker, []() {return buffer.size() < maxBufferSize; });
+       buffer.push_back(val);
+       locker.unlock();
+       cond.notify_one();
+   }
+}
+
+bool dequeConsumer(int count) {
+   bool inOrder = true;
+   for (int expected = 0; expected < count; ++expected) {
+       std::unique_lock<std::mutex> locker(mu);
+       cond.wait(locker, []() {return buffer.size() > 0; });
+       int val = buffer.front(); // front : FIFO, so the order can be checked.
+       buffer.pop_front();
+       locker.unlock();
+       cond.notify_one();
+       inOrder &= (val == expected);
+   }
+   return inOrder;
+}
+
+template<class Produce, class Consume>
+void bench(const char* name, int count, Produce produce, Consume consume) {
+   bool inOrder = false;
+   auto t0 = std::chrono::steady_clock::now();
+   std::thread p(produce, count);
+   std::thread c([&] { inOrder = consume(count); });
+   p.join();
+   c.join();
+   double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+   printf("%-26s %8.2f M items/s   %s\n", name, count / sec / 1e6, inOrder ? "FIFO ok" : "ORDER BROKEN");
+}
+
+template<class T>
+void benchRing(const char* name, int count, size_t capacity, WaitMode mode) {
+   SPSCRingBuffer<T> ring(capacity, mode);
+   bench(name, count,
+         [&ring](int n) { for (int i = 0; i < n; ++i) ring.push(i); },
+         [&ring](int n) {
+             bool ok = true;
+             for (int expected = 0; expected < n; ++expected) {
+                 T v;
+                 ring.pop(v);
+                 ok &= (v == expected);
+             }
+             return ok;
+         });
+}
+
+int main() {
+   const int N = 10000000;
+   std::cout << "Moving " << N << " ints from one producer to one consumer\n";
+   bench("mutex + deque (50)", N, dequeProducer, dequeConsumer);
+   benchRing<int>("SPSC ring (64), Block", N, 64, WaitMode::Block);
+   benchRing<int>("SPSC ring (1024), Block", N, 1024, WaitMode::Block);
+   benchRing<int>("SPSC ring (1024), Spin", N, 1024, WaitMode::Spin);
+   return 0;
+}
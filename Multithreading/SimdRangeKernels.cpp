@@ -0,0 +1,432 @@
+//****** SIMD kernels for findOdd style loops ******//
+
+//NOTES :
+//1. findOdd does `if (i & 1) OddSum += i;` : a compare and a branch for every element, and with
+//   `typedef long int ull` every element is a 64 bit integer. Depending on the compiler flags it
+//   is not vectorized at all.
+//2. This file writes the SIMD version by hand for a family of such loops. The predicate is
+//   "(x & mask) == match" (odd numbers : mask = 1, match = 1) :
+//   a. masked_sum / masked_count over an integer range [first, last] or over an array.
+//   b. min / max over an array.
+//3. Kernels :
+//   a. Scalar  -> plain loops, used everywhere and as the reference.
+//   b. SSE4.2  -> 2 x int64 per instruction. _mm_cmpgt_epi64 (needed for min/max) is SSE4.2.
+//   c. AVX2    -> 4 x int64 per instruction.
+//   The predicate becomes a compare that produces an all-ones/all-zeros lane, then
+//   sum += value & lane and count -= lane (all-ones is -1). No branch at all.
+//4. The SIMD functions are compiled with __attribute__((target(...))), so the file builds without
+//   -mavx2 and still runs on an old CPU : kernels() checks the CPU once at startup
+//   (__builtin_cpu_supports) and picks the best version.
+//5. main() checks every kernel against the scalar loop on random inputs (including odd tails and
+//   negative numbers) and then times the findOdd workload.
+
+//Compile : g++ -std=c++17 -O2 SimdRangeKernels.cpp
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+struct Kernels {
+   const char* name;
+   int64_t (*rangeMaskedSum)(int64_t first, int64_t last, int64_t mask, int64_t match);
+   int64_t (*rangeMaskedCount)(int64_t first, int64_t last, int64_t mask, int64_t match);
+   int64_t (*arrayMaskedSum)(const int64_t* data, size_t n, int64_t mask, int64_t match);
+   int64_t (*arrayMaskedCount)(const int64_t* data, size_t n, int64_t mask, int64_t match);
+   int64_t (*arrayMin)(const int64_t* data, size_t n);
+   int64_t (*arrayMax)(const int64_t* data, size_t n);
+};
+
+// Sums wrap around like the SIMD adds do, so they are done in unsigned arithmetic.
+inline int64_t wrapAdd(int64_t a, int64_t b) {
+   return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+}
+
+//====== Scalar ======//
+
+namespace scalar {
+
+int64_t rangeMaskedSum(int64_t first, int64_t last, int64_t mask, int64_t match) {
+   int64_t sum = 0;
+   for (int64_t i = first; i <= last; ++i) {
+       if ((i & mask) == match)
+           sum = wrapAdd(sum, i);
+       if (i == std::numeric_limits<int64_t>::max())
+           break;
+   }
+   return sum;
+}
+
+int64_t rangeMaskedCount(int64_t first, int64_t last, int64_t mask, int64_t match) {
+   int64_t count = 0;
+   for (int64_t i = first; i <= last; ++i) {
+       count += (i & mask) == match;
+       if (i == std::numeric_limits<int64_t>::max())
+           break;
+   }
+   return count;
+}
+
+int64_t arrayMaskedSum(const int64_t* data, size_t n, int64_t mask, int64_t match) {
+   int64_t sum = 0;
+   for (size_t i = 0; i < n; ++i)
+       if ((data[i] & mask) == match)
+           sum = wrapAdd(sum, data[i]);
+   return sum;
+}
+
+int64_t arrayMaskedCount(const int64_t* data, size_t n, int64_t mask, int64_t match) {
+   int64_t count = 0;
+   for (size_t i = 0; i < n; ++i)
+       count += (data[i] & mask) == match;
+   return count;
+}
+
+// Empty input : min returns INT64_MAX, max returns INT64_MIN (the identities).
+int64_t arrayMin(const int64_t* data, size_t n) {
+   int64_t m = std::numeric_limits<int64_t>::max();
+   for (size_t i = 0; i < n; ++i)
+       if (data[i] < m)
+           m = data[i];
+   return m;
+}
+
+int64_t arrayMax(const int64_t* data, size_t n) {
+   int64_t m = std::numeric_limits<int64_t>::min();
+   for (size_t i = 0; i < n; ++i)
+       if (data[i] > m)
+           m = data[i];
+   return m;
+}
+
+const Kernels kernels = { "scalar", rangeMaskedSum, rangeMaskedCount, arrayMaskedSum,
+                          arrayMaskedCount, arrayMin, arrayMax };
+
+} // namespace scalar
+
+#ifdef SIMD_X86
+
+//====== SSE4.2 : 2 lanes ======//
+
+namespace sse42 {
+
+#define SSE42 __attribute__((target("sse4.2")))
+
+SSE42 inline int64_t hsum(__m128i v) {
+   return wrapAdd(_mm_cvtsi128_si64(v), _mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v)));
+}
+
+// Number of SIMD-covered elements of [first, last] : stop before last - 1 could overflow.
+inline uint64_t rangeLength(int64_t first, int64_t last) {
+   return static_cast<uint64_t>(last) - static_cast<uint64_t>(first) + 1; // 0 means 2^64 : not used.
+}
+
+// first + k without signed overflow (lanes past INT64_MAX wrap, they are never counted).
+inline int64_t offset(int64_t first, uint64_t k) {
+   return static_cast<int64_t>(static_cast<uint64_t>(first) + k);
+}
+
+SSE42 int64_t rangeMaskedSum(int64_t first, int64_t last, int64_t mask, int64_t match) {
+   if (first > last)
+       return 0;
+   uint64_t n = rangeLength(first, last);
+   uint64_t vecN = n == 0 ? 0 : n - n % 2;
+   __m128i idx = _mm_set_epi64x(offset(first, 1), first);
+   const __m128i step = _mm_set1_epi64x(2), m = _mm_set1_epi64x(mask), want = _mm_set1_epi64x(match);
+   __m128i sum = _mm_setzero_si128();
+   for (uint64_t i = 0; i < vecN; i += 2) {
+       __m128i hit = _mm_cmpeq_epi64(_mm_and_si128(idx, m), want);
+       sum = _mm_add_epi64(sum, _mm_and_si128(idx, hit));
+       idx = _mm_add_epi64(idx, step);
+   }
+   int64_t s = hsum(sum);
+   if (vecN < n)
+       s = wrapAdd(s, scalar::rangeMaskedSum(offset(first, vecN), last, mask, match));
+   return s;
+}
+
+SSE42 int64_t rangeMaskedCount(int64_t first, int64_t last, int64_t mask, int64_t match) {
+   if (first > last)
+       return 0;
+   uint64_t n = rangeLength(first, last);
+   uint64_t vecN = n == 0 ? 0 : n - n % 2;
+   __m128i idx = _mm_set_epi64x(offset(first, 1), first);
+   const __m128i step = _mm_set1_epi64x(2), m = _mm_set1_epi64x(mask), want = _mm_set1_epi64x(match);
+   __m128i count = _mm_setzero_si128();
+   for (uint64_t i = 0; i < vecN; i += 2) {
+       count = _mm_sub_epi64(count, _mm_cmpeq_epi64(_mm_and_si128(idx, m), want));
+       idx = _mm_add_epi64(idx, step);
+   }
+   int64_t c = hsum(count);
+   if (vecN < n)
+       c += scalar::rangeMaskedCount(offset(first, vecN), last, mask, match);
+   return c;
+}
+
+SSE42 int64_t arrayMaskedSum(const int64_t* data, size_t n, int64_t mask, int64_t match) {
+   const __m128i m = _mm_set1_epi64x(mask), want = _mm_set1_epi64x(match);
+   __m128i sum = _mm_setzero_si128();
+   size_t i = 0;
+   for (; i + 2 <= n; i += 2) {
+       __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+       __m128i hit = _mm_cmpeq_epi64(_mm_and_si128(v, m), want);
+       sum = _mm_add_epi64(sum, _mm_and_si128(v, hit));
+   }
+   return wrapAdd(hsum(sum), scalar::arrayMaskedSum(data + i, n - i, mask, match));
+}
+
+SSE42 int64_t arrayMaskedCount(const int64_t* data, size_t n, int64_t mask, int64_t match) {
+   const __m128i m = _mm_set1_epi64x(mask), want = _mm_set1_epi64x(match);
+   __m128i count = _mm_setzero_si128();
+   size_t i = 0;
+   for (; i + 2 <= n; i += 2) {
+       __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+       count = _mm_sub_epi64(count, _mm_cmpeq_epi64(_mm_and_si128(v, m), want));
+   }
+   return hsum(count) + scalar::arrayMaskedCount(data + i, n - i, mask, match);
+}
+
+SSE42 int64_t arrayMin(const int64_t* data, size_t n) {
+   __m128i best = _mm_set1_epi64x(std::numeric_limits<int64_t>::max());
+   size_t i = 0;
+   for (; i + 2 <= n; i += 2) {
+       __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+       best = _mm_blendv_epi8(best, v, _mm_cmpgt_epi64(best, v)); // Take v where best > v.
+   }
+   int64_t a = _mm_cvtsi128_si64(best), b = _mm_cvtsi128_si64(_mm_unpackhi_epi64(best, best));
+   int64_t m = a < b ? a : b;
+   int64_t t = scalar::arrayMin(data + i, n - i);
+   return t < m ? t : m;
+}
+
+SSE42 int64_t arrayMax(const int64_t* data, size_t n) {
+   __m128i best = _mm_set1_epi64x(std::numeric_limits<int64_t>::min());
+   size_t i = 0;
+   for (; i + 2 <= n; i += 2) {
+       __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+       best = _mm_blendv_epi8(best, v, _mm_cmpgt_epi64(v, best)); // Take v where v > best.
+   }
+   int64_t a = _mm_cvtsi128_si64(best), b = _mm_cvtsi128_si64(_mm_unpackhi_epi64(best, best));
+   int64_t m = a > b ? a : b;
+   int64_t t = scalar::arrayMax(data + i, n - i);
+   return t > m ? t : m;
+}
+
+#undef SSE42
+
+const Kernels kernels = { "sse4.2", rangeMaskedSum, rangeMaskedCount, arrayMaskedSum,
+                          arrayMaskedCount, arrayMin, arrayMax };
+
+} // namespace sse42
+
+//====== AVX2 : 4 lanes ======//
+
+namespace avx2 {
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 inline int64_t hsum(__m256i v) {
+   __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+   return wrapAdd(_mm_cvtsi128_si64(s), _mm_cvtsi128_si64(_mm_unpackhi_epi64(s, s)));
+}
+
+AVX2 inline void lanes(__m256i v, int64_t out[4]) {
+   _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), v);
+}
+
+AVX2 int64_t rangeMaskedSum(int64_t first, int64_t last, int64_t mask, int64_t match) {
+   if (first > last)
+       return 0;
+   uint64_t n = sse42::rangeLength(first, last);
+   uint64_t vecN = n == 0 ? 0 : n - n % 4;
+   __m256i idx = _mm256_set_epi64x(sse42::offset(first, 3), sse42::offset(first, 2), sse42::offset(first, 1), first);
+   const __m256i step = _mm256_set1_epi64x(4), m = _mm256_set1_epi64x(mask), want = _mm256_set1_epi64x(match);
+   __m256i sum = _mm256_setzero_si256();
+   for (uint64_t i = 0; i < vecN; i += 4) {
+       __m256i hit = _mm256_cmpeq_epi64(_mm256_and_si256(idx, m), want);
+       sum = _mm256_add_epi64(sum, _mm256_and_si256(idx, hit));
+       idx = _mm256_add_epi64(idx, step);
+   }
+   int64_t s = hsum(sum);
+   if (vecN < n)
+       s = wrapAdd(s, scalar::rangeMaskedSum(sse42::offset(first, vecN), last, mask, match));
+   return s;
+}
+
+AVX2 int64_t rangeMaskedCount(int64_t first, int64_t last, int64_t mask, int64_t match) {
+   if (first > last)
+       return 0;
+   uint64_t n = sse42::rangeLength(first, last);
+   uint64_t vecN = n == 0 ? 0 : n - n % 4;
+   __m256i idx = _mm256_set_epi64x(sse42::offset(first, 3), sse42::offset(first, 2), sse42::offset(first, 1), first);
+   const __m256i step = _mm256_set1_epi64x(4), m = _mm256_set1_epi64x(mask), want = _mm256_set1_epi64x(match);
+   __m256i count = _mm256_setzero_si256();
+   for (uint64_t i = 0; i < vecN; i += 4) {
+       count = _mm256_sub_epi64(count, _mm256_cmpeq_epi64(_mm256_and_si256(idx, m), want));
+       idx = _mm256_add_epi64(idx, step);
+   }
+   int64_t c = hsum(count);
+   if (vecN < n)
+       c += scalar::rangeMaskedCount(sse42::offset(first, vecN), last, mask, match);
+   return c;
+}
+
+AVX2 int64_t arrayMaskedSum(const int64_t* data, size_t n, int64_t mask, int64_t match) {
+   const __m256i m = _mm256_set1_epi64x(mask), want = _mm256_set1_epi64x(match);
+   __m256i sum = _mm256_setzero_si256();
+   size_t i = 0;
+   for (; i + 4 <= n; i += 4) {
+       __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+       __m256i hit = _mm256_cmpeq_epi64(_mm256_and_si256(v, m), want);
+       sum = _mm256_add_epi64(sum, _mm256_and_si256(v, hit));
+   }
+   return wrapAdd(hsum(sum), scalar::arrayMaskedSum(data + i, n - i, mask, match));
+}
+
+AVX2 int64_t arrayMaskedCount(const int64_t* data, size_t n, int64_t mask, int64_t match) {
+   const __m256i m = _mm256_set1_epi64x(mask), want = _mm256_set1_epi64x(match);
+   __m256i count = _mm256_setzero_si256();
+   size_t i = 0;
+   for (; i + 4 <= n; i += 4) {
+       __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+       count = _mm256_sub_epi64(count, _mm256_cmpeq_epi64(_mm256_and_si256(v, m), want));
+   }
+   return hsum(count) + scalar::arrayMaskedCount(data + i, n - i, mask, match);
+}
+
+AVX2 int64_t arrayMin(const int64_t* data, size_t n) {
+   __m256i best = _mm256_set1_epi64x(std::numeric_limits<int64_t>::max());
+   size_t i = 0;
+   for (; i + 4 <= n; i += 4) {
+       __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+       best = _mm256_blendv_epi8(best, v, _mm256_cmpgt_epi64(best, v));
+   }
+   int64_t l[4];
+   lanes(best, l);
+   int64_t m = scalar::arrayMin(l, 4);
+   int64_t t = scalar::arrayMin(data + i, n - i);
+   return t < m ? t : m;
+}
+
+AVX2 int64_t arrayMax(const int64_t* data, size_t n) {
+   __m256i best = _mm256_set1_epi64x(std::numeric_limits<int64_t>::min());
+   size_t i = 0;
+   for (; i + 4 <= n; i += 4) {
+       __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+       best = _mm256_blendv_epi8(best, v, _mm256_cmpgt_epi64(v, best));
+   }
+   int64_t l[4];
+   lanes(best, l);
+   int64_t m = scalar::arrayMax(l, 4);
+   int64_t t = scalar::arrayMax(data + i, n - i);
+   return t > m ? t : m;
+}
+
+#undef AVX2
+
+const Kernels kernels = { "avx2", rangeMaskedSum, rangeMaskedCount, arrayMaskedSum,
+                          arrayMaskedCount, arrayMin, arrayMax };
+
+} // namespace avx2
+
+#endif // SIMD_X86
+
+// Every kernel set this CPU can run, best first.
+std::vector<const Kernels*> supportedKernels() {
+   std::vector<const Kernels*> list;
+#ifdef SIMD_X86
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2"))
+       list.push_back(&avx2::kernels);
+   if (__builtin_cpu_supports("sse4.2"))
+       list.push_back(&sse42::kernels);
+#endif
+   list.push_back(&scalar::kernels);
+   return list;
+}
+
+// Picked once, on first use.
+const Kernels& kernels() {
+   static const Kernels* best = supportedKernels().front();
+   return *best;
+}
+
+//====== Self check against the scalar loops ======//
+
+int checkKernels() {
+   std::mt19937_64 rng(12345);
+   int failures = 0;
+   auto expect = [&failures](const Kernels* k, const char* what, int64_t got, int64_t want) {
+       if (got != want) {
+           ++failures;
+           std::cout << "  FAIL " << k->name << " " << what << " : got " << got << ", want " << want << "\n";
+       }
+   };
+
+   for (const Kernels* k : supportedKernels()) {
+       for (int round = 0; round < 300; ++round) {
+           // Arrays : every length 0..64 (all tails) plus some long ones, values of any sign.
+           size_t n = round < 65 ? round : rng() % 5000;
+           std::vector<int64_t> v(n);
+           for (auto& x : v)
+               x = static_cast<int64_t>(rng()) >> (rng() % 60);
+           int64_t mask = static_cast<int64_t>(rng() % 8), match = static_cast<int64_t>(rng() % 8) & mask;
+           expect(k, "arrayMaskedSum", k->arrayMaskedSum(v.data(), n, mask, match), scalar::arrayMaskedSum(v.data(), n, mask, match));
+           expect(k, "arrayMaskedCount", k->arrayMaskedCount(v.data(), n, mask, match), scalar::arrayMaskedCount(v.data(), n, mask, match));
+           expect(k, "arrayMin", k->arrayMin(v.data(), n), scalar::arrayMin(v.data(), n));
+           expect(k, "arrayMax", k->arrayMax(v.data(), n), scalar::arrayMax(v.data(), n));
+
+           // Ranges : negative and positive bounds, empty ranges, odd lengths.
+           int64_t first = static_cast<int64_t>(rng() % 20000) - 10000;
+           int64_t last = first + static_cast<int64_t>(rng() % 3000) - 5;
+           expect(k, "rangeMaskedSum", k->rangeMaskedSum(first, last, mask, match), scalar::rangeMaskedSum(first, last, mask, match));
+           expect(k, "rangeMaskedCount", k->rangeMaskedCount(first, last, mask, match), scalar::rangeMaskedCount(first, last, mask, match));
+       }
+       // Ranges touching INT64_MAX must not overflow the loop counter or the lane starts.
+       int64_t top = std::numeric_limits<int64_t>::max();
+       for (int64_t width : { 0, 1, 2, 3, 10 }) {
+           expect(k, "rangeMaskedCount(top)", k->rangeMaskedCount(top - width, top, 1, 1), scalar::rangeMaskedCount(top - width, top, 1, 1));
+           expect(k, "rangeMaskedSum(top)", k->rangeMaskedSum(top - width, top, 1, 1), scalar::rangeMaskedSum(top - width, top, 1, 1));
+       }
+       std::cout << "kernel " << k->name << " checked\n";
+   }
+   return failures;
+}
+
+typedef long int ull;
+
+ull findOdd(ull start, ull end) {
+   ull OddSum = 0;
+   for (ull i = start; i <= end; ++i) {
+       if (i & 1) {
+           OddSum += i;
+       }
+   }
+   return OddSum;
+}
+
+int main() {
+   int failures = checkKernels();
+   std::cout << (failures ? "Self check FAILED\n" : "Self check passed\n");
+   std::cout << "Selected kernel : " << kernels().name << "\n\n";
+
+   const ull start = 0, end = 1900000000;
+   auto t0 = std::chrono::steady_clock::now();
+   ull expected = findOdd(start, end);
+   auto t1 = std::chrono::steady_clock::now();
+   int64_t sum = kernels().rangeMaskedSum(start, end, 1, 1);
+   auto t2 = std::chrono::steady_clock::now();
+
+   auto ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+   printf("findOdd         : %lld in %.1f ms\n", static_cast<long long>(expected), ms(t1 - t0));
+   printf("rangeMaskedSum  : %lld in %.1f ms (%s)\n", static_cast<long long>(sum), ms(t2 - t1), kernels().name);
+   return failures ? 1 : 0;
+}
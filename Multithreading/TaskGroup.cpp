@@ -0,0 +1,215 @@
+//****** Fork-Join task_group with help-while-waiting ******//
+
+//NOTES :
+//1. Divide and conquer on ThreadPool.cpp : a task enqueues its children on the same pool and then
+//   blocks until they finish. Every blocked parent holds a worker, so with deep recursion all
+//   workers end up waiting for children that nobody is left to run -> DEADLOCK.
+//   Creating extra threads to avoid that just oversubscribes the cores.
+//2. task_group :
+//   a. run(f)  -> counts f as pending and enqueues it on the pool.
+//   b. wait()  -> until the count is zero, the waiting thread pops tasks from the pool queue and
+//                 runs them itself (help while waiting). It only sleeps when the queue is empty,
+//                 i.e. when the children are already running on other workers.
+//3. wait() works from a worker thread AND from outside the pool (main also helps).
+//4. The first exception thrown by a child is rethrown from wait().
+//5. main() runs a parallel quicksort and a tree reduction on a 4 thread pool.
+
+//Compile : g++ -std=c++17 -O2 -pthread TaskGroup.cpp
+
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <random>
+#include <numeric>
+#include <chrono>
+
+class ThreadPool {
+public:
+   ThreadPool(size_t numThreads) : stop(false) {
+       for (size_t i = 0; i < numThreads; ++i) {
+           workers.emplace_back([this] {
+               for (;;) {
+                   std::unique_lock<std::mutex> lock(queueMutex);
+                   condition.wait(lock, [this] { return stop || !tasks.empty(); });
+                   if (stop && tasks.empty())
+                       return;
+                   auto task = std::move(tasks.front());
+                   tasks.pop();
+                   lock.unlock();
+                   task();
+               }
+               });
+       }
+   }
+
+   template<class F>
+   void enqueue(F&& task) {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       tasks.emplace(std::forward<F>(task));
+       lock.unlock();
+       condition.notify_one();
+   }
+
+   // Runs one queued task on the calling thread. Returns false if the queue was empty.
+   bool try_run_one() {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       if (tasks.empty())
+           return false;
+       auto task = std::move(tasks.front());
+       tasks.pop();
+       lock.unlock();
+       task();
+       return true;
+   }
+
+   ~ThreadPool() {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       stop = true;
+       lock.unlock();
+       condition.notify_all();
+       for (std::thread& worker : workers)
+           worker.join();
+   }
+
+private:
+   std::vector<std::thread> workers;
+   std::queue<std::function<void()>> tasks;
+
+   std::mutex queueMutex;
+   std::condition_variable condition;
+   bool stop;
+};
+
+class task_group {
+public:
+   explicit task_group(ThreadPool& pool) : pool(pool), pending(0) {}
+
+   task_group(const task_group&) = delete;
+   task_group& operator=(const task_group&) = delete;
+
+   // A group must be waited on before it goes away, children hold a reference to it.
+   ~task_group() { waitAll(); }
+
+   template<class F>
+   void run(F&& f) {
+       pending.fetch_add(1, std::memory_order_relaxed);
+       pool.enqueue([this, fn = std::forward<F>(f)]() mutable {
+           try {
+               fn();
+           }
+           catch (...) {
+               std::lock_guard<std::mutex> lock(mutex);
+               if (!error)
+                   error = std::current_exception();
+           }
+           // Decrement under the lock : once wait() has seen zero and taken the lock, no child
+           // touches the group any more and it is safe to destroy.
+           std::lock_guard<std::mutex> lock(mutex);
+           if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+               done.notify_all();
+       });
+   }
+
+   void wait() {
+       waitAll();
+       std::exception_ptr e;
+       {
+           std::lock_guard<std::mutex> lock(mutex);
+           std::swap(e, error);
+       }
+       if (e)
+           std::rethrow_exception(e);
+   }
+
+private:
+   void waitAll() {
+       while (pending.load(std::memory_order_acquire) != 0) {
+           if (pool.try_run_one())
+               continue; // Helped with some work, check again.
+
+           // Queue is empty : our children are running elsewhere. Sleep a little, but wake up
+           // now and then in case they enqueue grandchildren we could help with.
+           std::unique_lock<std::mutex> lock(mutex);
+           done.wait_for(lock, std::chrono::microseconds(200),
+                         [this] { return pending.load(std::memory_order_acquire) == 0; });
+       }
+       std::lock_guard<std::mutex> lock(mutex); // Let the last child leave its critical section.
+   }
+
+   ThreadPool& pool;
+   std::atomic<size_t> pending;
+   std::mutex mutex;
+   std::condition_variable done;
+   std::exception_ptr error;
+};
+
+// Parallel quicksort : recursion forks into the same pool, small ranges sort sequentially.
+void parallelQuickSort(ThreadPool& pool, std::vector<int>& v, long lo, long hi) {
+   if (hi - lo < 10000) {
+       std::sort(v.begin() + lo, v.begin() + hi);
+       return;
+   }
+   int pivot = v[lo + (hi - lo) / 2];
+   auto mid1 = std::partition(v.begin() + lo, v.begin() + hi, [pivot](int x) { return x < pivot; });
+   auto mid2 = std::partition(mid1, v.begin() + hi, [pivot](int x) { return x == pivot; });
+   long m1 = mid1 - v.begin(), m2 = mid2 - v.begin();
+
+   task_group group(pool);
+   group.run([&pool, &v, lo, m1] { parallelQuickSort(pool, v, lo, m1); });
+   parallelQuickSort(pool, v, m2, hi); // The parent works on one half itself.
+   group.wait();
+}
+
+// Tree reduction : split in two until the range is small.
+long long treeSum(ThreadPool& pool, const std::vector<int>& v, size_t lo, size_t hi) {
+   if (hi - lo < 50000)
+       return std::accumulate(v.begin() + lo, v.begin() + hi, 0LL);
+   size_t mid = lo + (hi - lo) / 2;
+   long long left = 0;
+   task_group group(pool);
+   group.run([&] { left = treeSum(pool, v, lo, mid); });
+   long long right = treeSum(pool, v, mid, hi);
+   group.wait();
+   return left + right;
+}
+
+int main() {
+   ThreadPool pool(4);
+
+   std::vector<int> data(5000000);
+   std::mt19937 rng(42);
+   for (int& x : data)
+       x = static_cast<int>(rng() % 1000000);
+   long long expected = std::accumulate(data.begin(), data.end(), 0LL);
+
+   // Every task below forks and waits inside the pool. Without helping, 4 workers would deadlock.
+   long long sum = 0;
+   task_group root(pool);
+   root.run([&] { sum = treeSum(pool, data, 0, data.size()); });
+   root.wait();
+   std::cout << "Tree reduction : " << sum << (sum == expected ? " (correct)" : " (WRONG)") << std::endl;
+
+   auto t0 = std::chrono::steady_clock::now();
+   root.run([&] { parallelQuickSort(pool, data, 0, static_cast<long>(data.size())); });
+   root.wait();
+   auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+   std::cout << "Parallel quicksort : " << ms << " ms, "
+             << (std::is_sorted(data.begin(), data.end()) ? "sorted" : "NOT sorted") << std::endl;
+
+   // Exceptions from children come out of wait().
+   task_group failing(pool);
+   failing.run([] { throw std::runtime_error("child failed"); });
+   try {
+       failing.wait();
+   }
+   catch (const std::exception& e) {
+       std::cout << "Caught : " << e.what() << std::endl;
+   }
+   return 0;
+}
@@ -0,0 +1,390 @@
+//****** Thread Pool with submit() and continuations ******//
+
+//NOTES :
+//1. ThreadPool::enqueue returns void, so to get a result back we had to wrap the task in
+//   std::promise (like FutureAndPromises.cpp) : one more heap allocation and a locked
+//   shared state for every task.
+//2. submit(f, args...) returns a Future<T>. The task and its result share ONE small state
+//   object. Checking "is it ready?" is a single atomic load. The mutex is taken once when the
+//   value is published (to wake waiters and fire continuations) and when a continuation is
+//   registered.
+//3. Continuations :
+//   a. future.then(fn)        -> fn(value) is enqueued on the pool once the value is ready
+//                                (fn() for a Future<void>).
+//   b. when_all(pool, list)   -> Future<vector<T>>, ready when every input is ready.
+//   c. when_any(pool, list)   -> Future<pair<index, T>>, ready when the first input is ready.
+//4. Continuations are never run by a worker that sits in get(). The completing thread just
+//   enqueues them, so no worker ever blocks waiting on another task.
+//5. Exceptions thrown by a task travel down the chain and are rethrown from get().
+//6. get() blocks, so call it from outside the pool (e.g. main), never from inside a task.
+
+//Compile : g++ -std=c++17 -O2 -pthread ThreadPoolFuture.cpp
+
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <future>
+#include <stdexcept>
+#include <type_traits>
+#include <chrono>
+
+class ThreadPool;
+
+struct Unit {}; // Stands in for "no value" so Future<void> can share the same state.
+
+template<class T>
+class Future;
+
+namespace detail {
+
+template<class T>
+using Stored = std::conditional_t<std::is_void_v<T>, Unit, T>;
+
+template<class T>
+struct SharedState {
+   std::atomic<bool> ready{ false };
+   std::mutex mutex;
+   std::condition_variable cv;
+   std::optional<Stored<T>> value;
+   std::exception_ptr error;
+   std::vector<std::function<void()>> callbacks;
+
+   void setValue(Stored<T> v) {
+       value.emplace(std::move(v));
+       publish();
+   }
+
+   void setError(std::exception_ptr e) {
+       error = e;
+       publish();
+   }
+
+   // Runs cb right away if already ready, otherwise when the value arrives.
+   // Callbacks are tiny (they only enqueue or count), so they run inline.
+   template<class F>
+   void onReady(F&& cb) {
+       std::unique_lock<std::mutex> lock(mutex);
+       if (!ready.load(std::memory_order_acquire)) {
+           callbacks.emplace_back(std::forward<F>(cb));
+           return;
+       }
+       lock.unlock();
+       cb();
+   }
+
+private:
+   void publish() {
+       std::vector<std::function<void()>> fire;
+       {
+           std::lock_guard<std::mutex> lock(mutex);
+           ready.store(true, std::memory_order_release);
+           fire.swap(callbacks);
+       }
+       cv.notify_all();
+       for (auto& cb : fire)
+           cb();
+   }
+};
+
+// Result type of a continuation : fn(const T&), or fn() when T is void.
+template<class T, class F>
+struct ContinuationResult {
+   using type = std::invoke_result_t<F, const T&>;
+};
+
+template<class F>
+struct ContinuationResult<void, F> {
+   using type = std::invoke_result_t<F>;
+};
+
+// Calls fn(args...) and stores the result (or the exception) into state.
+template<class T, class F, class... Args>
+void runInto(SharedState<T>& state, F& fn, Args&&... args) {
+   try {
+       if constexpr (std::is_void_v<T>) {
+           std::invoke(fn, std::forward<Args>(args)...);
+           state.setValue(Unit{});
+       }
+       else {
+           state.setValue(std::invoke(fn, std::forward<Args>(args)...));
+       }
+   }
+   catch (...) {
+       state.setError(std::current_exception());
+   }
+}
+
+} // namespace detail
+
+class ThreadPool {
+public:
+   ThreadPool(size_t numThreads) : stop(false) {
+       for (size_t i = 0; i < numThreads; ++i) {
+           workers.emplace_back([this] {
+               for (;;) {
+                   std::unique_lock<std::mutex> lock(queueMutex);
+                   condition.wait(lock, [this] { return stop || !tasks.empty(); });
+                   if (stop && tasks.empty())
+                       return;
+                   auto task = std::move(tasks.front());
+                   tasks.pop();
+                   lock.unlock();
+                   task();
+               }
+               });
+       }
+   }
+
+   template<class F>
+   void enqueue(F&& task) {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       tasks.emplace(std::forward<F>(task));
+       lock.unlock();
+       condition.notify_one();
+   }
+
+   // Like enqueue, but hands back a Future for the result of f(args...).
+   template<class F, class... Args>
+   auto submit(F&& f, Args&&... args) -> Future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>;
+
+   ~ThreadPool() {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       stop = true;
+       lock.unlock();
+       condition.notify_all();
+       for (std::thread& worker : workers)
+           worker.join();
+   }
+
+private:
+   std::vector<std::thread> workers;
+   std::queue<std::function<void()>> tasks;
+
+   std::mutex queueMutex;
+   std::condition_variable condition;
+   bool stop;
+};
+
+template<class T>
+class Future {
+public:
+   Future() = default;
+   Future(ThreadPool* pool, std::shared_ptr<detail::SharedState<T>> state)
+       : pool(pool), state(std::move(state)) {}
+
+   bool valid() const { return state != nullptr; }
+   bool is_ready() const { return state->ready.load(std::memory_order_acquire); }
+
+   void wait() const {
+       if (is_ready())
+           return; // Fast path : no lock at all.
+       std::unique_lock<std::mutex> lock(state->mutex);
+       state->cv.wait(lock, [this] { return state->ready.load(std::memory_order_acquire); });
+   }
+
+   // Blocks the caller. Do not call from a pool task, use then() instead.
+   detail::Stored<T> get() const {
+       wait();
+       if (state->error)
+           std::rethrow_exception(state->error);
+       return *state->value;
+   }
+
+   // fn(value) (or fn() for Future<void>) runs on the pool after this future is ready.
+   template<class F>
+   auto then(F&& fn) const {
+       using Result = typename detail::ContinuationResult<T, std::decay_t<F>>::type;
+       auto next = std::make_shared<detail::SharedState<Result>>();
+       auto src = state;
+       ThreadPool* p = pool;
+       state->onReady([p, src, next, fn = std::forward<F>(fn)]() mutable {
+           if (src->error) { // Skip fn, just pass the exception along.
+               next->setError(src->error);
+               return;
+           }
+           p->enqueue([src, next, fn = std::move(fn)]() mutable {
+               if constexpr (std::is_void_v<T>)
+                   detail::runInto(*next, fn);
+               else
+                   detail::runInto(*next, fn, static_cast<const T&>(*src->value));
+           });
+       });
+       return Future<Result>(pool, next);
+   }
+
+private:
+   template<class U> friend Future<std::vector<U>> when_all(ThreadPool&, const std::vector<Future<U>>&);
+   template<class U> friend Future<std::pair<size_t, U>> when_any(ThreadPool&, const std::vector<Future<U>>&);
+
+   ThreadPool* pool = nullptr;
+   std::shared_ptr<detail::SharedState<T>> state;
+};
+
+template<class F, class... Args>
+auto ThreadPool::submit(F&& f, Args&&... args) -> Future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>> {
+   using T = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+   auto state = std::make_shared<detail::SharedState<T>>();
+   enqueue([state, fn = std::forward<F>(f), argsTuple = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+       std::apply([&](auto&... a) { detail::runInto(*state, fn, a...); }, argsTuple);
+   });
+   return Future<T>(this, state);
+}
+
+// Ready once every input is ready. The last input to finish enqueues the gathering step.
+template<class T>
+Future<std::vector<T>> when_all(ThreadPool& pool, const std::vector<Future<T>>& inputs) {
+   static_assert(!std::is_void_v<T>, "when_all needs a value type");
+   auto out = std::make_shared<detail::SharedState<std::vector<T>>>();
+   if (inputs.empty()) {
+       out->setValue({});
+       return Future<std::vector<T>>(&pool, out);
+   }
+   auto remaining = std::make_shared<std::atomic<size_t>>(inputs.size());
+   auto states = std::make_shared<std::vector<std::shared_ptr<detail::SharedState<T>>>>();
+   for (const auto& f : inputs)
+       states->push_back(f.state);
+
+   for (const auto& s : *states) {
+       s->onReady([&pool, out, remaining, states] {
+           if (remaining->fetch_sub(1, std::memory_order_acq_rel) != 1)
+               return;
+           pool.enqueue([out, states] {
+               std::vector<T> values;
+               values.reserve(states->size());
+               for (const auto& st : *states) {
+                   if (st->error) {
+                       out->setError(st->error);
+                       return;
+                   }
+                   values.push_back(*st->value);
+               }
+               out->setValue(std::move(values));
+           });
+       });
+   }
+   return Future<std::vector<T>>(&pool, out);
+}
+
+// Ready with (index, value) of the first input that finishes. Later ones are ignored.
+template<class T>
+Future<std::pair<size_t, T>> when_any(ThreadPool& pool, const std::vector<Future<T>>& inputs) {
+   static_assert(!std::is_void_v<T>, "when_any needs a value type");
+   auto out = std::make_shared<detail::SharedState<std::pair<size_t, T>>>();
+   if (inputs.empty()) {
+       out->setError(std::make_exception_ptr(std::invalid_argument("when_any of nothing")));
+       return Future<std::pair<size_t, T>>(&pool, out);
+   }
+   auto won = std::make_shared<std::atomic<bool>>(false);
+   for (size_t i = 0; i < inputs.size(); ++i) {
+       auto s = inputs[i].state;
+       s->onReady([&pool, out, won, s, i] {
+           if (won->exchange(true, std::memory_order_acq_rel))
+               return;
+           pool.enqueue([out, s, i] {
+               if (s->error)
+                   out->setError(s->error);
+               else
+                   out->setValue({ i, *s->value });
+           });
+       });
+   }
+   return Future<std::pair<size_t, T>>(&pool, out);
+}
+
+typedef long int ull;
+
+ull findOdd(ull start, ull end) {
+   ull OddSum = 0;
+   for (ull i = start; i <= end; ++i) {
+       if (i & 1) {
+           OddSum += i;
+       }
+   }
+   return OddSum;
+}
+
+int main() {
+   ThreadPool pool(4);
+
+   // 1. submit + get
+   Future<ull> odd = pool.submit(findOdd, 0, 1000000);
+   std::cout << "OddSum : " << odd.get() << std::endl;
+
+   // 2. then : chained continuations, nobody blocks in between.
+   auto text = pool.submit([] { return 21; })
+       .then([](int v) { return v * 2; })
+       .then([](int v) { return "answer = " + std::to_string(v); });
+   std::cout << text.get() << std::endl;
+
+   // Future<void> : the continuation takes no argument.
+   std::atomic<int> hits(0);
+   auto after = pool.submit([&hits] { hits += 1; })
+       .then([&hits] { hits += 1; })
+       .then([&hits] { return hits.load(); });
+   std::cout << "void chain ran " << after.get() << " steps" << std::endl;
+
+   // 3. when_all : split findOdd in chunks, add the parts in a continuation.
+   const ull end = 100000000, chunks = 8;
+   std::vector<Future<ull>> parts;
+   for (ull c = 0; c < chunks; ++c)
+       parts.push_back(pool.submit(findOdd, c * end / chunks + (c ? 1 : 0), (c + 1) * end / chunks));
+   auto total = when_all(pool, parts).then([](const std::vector<ull>& v) {
+       ull sum = 0;
+       for (ull x : v) sum += x;
+       return sum;
+   });
+   std::cout << "OddSum (when_all) : " << total.get() << std::endl;
+
+   // 4. when_any : first finisher wins.
+   std::vector<Future<int>> racers;
+   for (int i = 0; i < 3; ++i)
+       racers.push_back(pool.submit([i] {
+           std::this_thread::sleep_for(std::chrono::milliseconds(30 * (3 - i)));
+           return i;
+       }));
+   auto first = when_any(pool, racers).get();
+   std::cout << "First finished : racer " << first.first << std::endl;
+
+   // 5. Exceptions skip the continuation and come out of get().
+   auto failed = pool.submit([]() -> int { throw std::runtime_error("task failed"); })
+       .then([](int v) { return v + 1; });
+   try {
+       failed.get();
+   }
+   catch (const std::exception& e) {
+       std::cout << "Caught : " << e.what() << std::endl;
+   }
+
+   // 6. Cost per task : promise wrapping vs submit.
+   const int N = 100000;
+   auto t0 = std::chrono::steady_clock::now();
+   {
+       std::vector<std::future<int>> futures;
+       futures.reserve(N);
+       for (int i = 0; i < N; ++i) {
+           auto p = std::make_shared<std::promise<int>>();
+           futures.push_back(p->get_future());
+           pool.enqueue([p, i] { p->set_value(i); });
+       }
+       for (auto& f : futures) f.get();
+   }
+   auto t1 = std::chrono::steady_clock::now();
+   {
+       std::vector<Future<int>> futures;
+       futures.reserve(N);
+       for (int i = 0; i < N; ++i)
+           futures.push_back(pool.submit([i] { return i; }));
+       for (auto& f : futures) f.get();
+   }
+   auto t2 = std::chrono::steady_clock::now();
+   std::cout << "promise + enqueue : " << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() << " ms\n";
+   std::cout << "submit            : " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << " ms\n";
+   return 0;
+}
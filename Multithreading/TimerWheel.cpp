@@ -0,0 +1,370 @@
+//****** Hierarchical Timer Wheel for delayed and periodic tasks ******//
+
+//NOTES :
+//1. A periodic job written like SleepAndWait.cpp is a thread that loops on sleep_for. 1000 jobs
+//   means 1000 sleeping threads (stacks, context switches) doing nothing most of the time.
+//2. TimerWheel : ONE timer thread owns every pending timer and hands due callbacks to a ThreadPool.
+//   a. schedule_after(delay, fn)  -> run fn once after delay.
+//   b. schedule_every(period, fn) -> run fn every period until cancelled.
+//   c. cancel(id)                 -> O(1), safe even if the timer has already fired.
+//3. Hierarchical wheel (like the Linux kernel timers), tick = 1 ms :
+//   a. 4 levels of 256 slots. Level 0 slot = 1 tick, level 1 slot = 256 ticks, level 2 slot =
+//      65536 ticks... so 4 levels cover 2^32 ms (about 49 days).
+//   b. Insert : pick the level from (expires - now) and the slot from the bits of `expires`. O(1).
+//   c. Every tick the level 0 slot is fired. When level 0 wraps around, the current slot of level 1
+//      is "cascaded" : its timers are re-inserted into lower levels, and so on up the levels.
+//      A cascaded timer due on this very tick goes into the level 0 slot about to be fired.
+//   d. Each slot is an intrusive doubly linked list, so cancel just unlinks the node. O(1).
+//4. Nodes live in one vector with a free list. TimerId carries a generation number, so a stale id
+//   (timer already fired and slot reused) can never cancel somebody else's timer.
+//5. Callbacks run on the pool, never on the timer thread, so a slow callback can't delay others.
+//6. The timer thread does not wake every tick : it sleeps until the next non-empty level 0 slot, or
+//   until level 0 wraps (the next cascade) when the rest of level 0 is empty. So a wheel holding
+//   only far timers wakes about every 256 ms. An add() due earlier than that wakes it up.
+
+//Compile : g++ -std=c++17 -O2 -pthread TimerWheel.cpp
+
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <array>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <cstdint>
+
+class ThreadPool {
+public:
+   ThreadPool(size_t numThreads) : stop(false) {
+       for (size_t i = 0; i < numThreads; ++i) {
+           workers.emplace_back([this] {
+               for (;;) {
+                   std::unique_lock<std::mutex> lock(queueMutex);
+                   condition.wait(lock, [this] { return stop || !tasks.empty(); });
+                   if (stop && tasks.empty())
+                       return;
+                   auto task = std::move(tasks.front());
+                   tasks.pop();
+                   lock.unlock();
+                   task();
+               }
+               });
+       }
+   }
+
+   template<class F>
+   void enqueue(F&& task) {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       tasks.emplace(std::forward<F>(task));
+       lock.unlock();
+       condition.notify_one();
+   }
+
+   ~ThreadPool() {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       stop = true;
+       lock.unlock();
+       condition.notify_all();
+       for (std::thread& worker : workers)
+           worker.join();
+   }
+
+private:
+   std::vector<std::thread> workers;
+   std::queue<std::function<void()>> tasks;
+
+   std::mutex queueMutex;
+   std::condition_variable condition;
+   bool stop;
+};
+
+struct TimerId {
+   uint32_t index = UINT32_MAX;
+   uint32_t generation = 0;
+};
+
+class TimerWheel {
+public:
+   using Clock = std::chrono::steady_clock;
+
+   static constexpr int Levels = 4;
+   static constexpr int SlotBits = 8;
+   static constexpr uint32_t Slots = 1u << SlotBits;
+
+   explicit TimerWheel(ThreadPool& pool, size_t expectedTimers = 1024) : pool(pool), start(Clock::now()) {
+       nodes.reserve(expectedTimers);
+       for (auto& level : wheel)
+           level.fill(Nil);
+       timerThread = std::thread([this] { run(); });
+   }
+
+   template<class F>
+   TimerId schedule_after(std::chrono::milliseconds delay, F&& fn) {
+       return add(delay, std::chrono::milliseconds(0), std::function<void()>(std::forward<F>(fn)));
+   }
+
+   template<class F>
+   TimerId schedule_every(std::chrono::milliseconds period, F&& fn) {
+       if (period.count() < 1)
+           period = std::chrono::milliseconds(1);
+       return add(period, period, std::function<void()>(std::forward<F>(fn)));
+   }
+
+   // Returns true if the timer was still pending. A periodic timer stops repeating.
+   bool cancel(TimerId id) {
+       std::lock_guard<std::mutex> lock(mutex);
+       if (id.index >= nodes.size() || nodes[id.index].generation != id.generation || !nodes[id.index].linked)
+           return false;
+       unlink(id.index);
+       release(id.index);
+       return true;
+   }
+
+   size_t pending() {
+       std::lock_guard<std::mutex> lock(mutex);
+       return active;
+   }
+
+   ~TimerWheel() {
+       {
+           std::lock_guard<std::mutex> lock(mutex);
+           stop = true;
+       }
+       wake.notify_one();
+       timerThread.join();
+   }
+
+private:
+   static constexpr uint32_t Nil = UINT32_MAX;
+
+   struct Node {
+       std::shared_ptr<std::function<void()>> fn; // Shared : a periodic callback is enqueued many times.
+       uint64_t expires = 0;
+       uint64_t period = 0; // 0 = one shot
+       uint32_t prev = Nil, next = Nil;
+       uint8_t level = 0;
+       uint8_t slot = 0;
+       bool linked = false;
+       uint32_t generation = 0;
+   };
+
+   uint64_t ticksNow() const {
+       return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+   }
+
+   TimerId add(std::chrono::milliseconds delay, std::chrono::milliseconds period, std::function<void()> fn) {
+       std::unique_lock<std::mutex> lock(mutex);
+       uint32_t index;
+       if (freeList != Nil) {
+           index = freeList;
+           freeList = nodes[index].next;
+       }
+       else {
+           index = static_cast<uint32_t>(nodes.size());
+           nodes.emplace_back();
+       }
+       Node& n = nodes[index];
+       n.fn = std::make_shared<std::function<void()>>(std::move(fn));
+       n.expires = ticksNow() + static_cast<uint64_t>(delay.count());
+       n.period = static_cast<uint64_t>(period.count());
+       insert(index);
+       ++active;
+       bool earlier = n.expires < sleepUntil;
+       TimerId id{ index, n.generation };
+       lock.unlock();
+       if (earlier)
+           wake.notify_one(); // Due before the tick the timer thread sleeps until.
+       return id;
+   }
+
+   // Called with the mutex held. `cascading` : called by advance() before the level 0 slot of
+   // currentTick is fired, so a timer due now can still go there.
+   void insert(uint32_t index, bool cascading = false) {
+       Node& n = nodes[index];
+       // Otherwise never into the slot of currentTick : it has already been fired (or detached).
+       uint64_t earliest = cascading ? currentTick : currentTick + 1;
+       uint64_t expires = n.expires > earliest ? n.expires : earliest;
+       uint64_t delta = expires - currentTick;
+       int level = 0;
+       while (level < Levels - 1 && delta >= (uint64_t(1) << (SlotBits * (level + 1))))
+           ++level;
+       if (level == Levels - 1 && delta >= (uint64_t(1) << (SlotBits * Levels)))
+           expires = currentTick + (uint64_t(1) << (SlotBits * Levels)) - 1; // Clamp to the wheel range.
+       uint32_t slot = (expires >> (SlotBits * level)) & (Slots - 1);
+
+       n.level = static_cast<uint8_t>(level);
+       n.slot = static_cast<uint8_t>(slot);
+       n.prev = Nil;
+       n.next = wheel[level][slot];
+       if (n.next != Nil)
+           nodes[n.next].prev = index;
+       wheel[level][slot] = index;
+       n.linked = true;
+   }
+
+   // Called with the mutex held.
+   void unlink(uint32_t index) {
+       Node& n = nodes[index];
+       if (n.prev != Nil)
+           nodes[n.prev].next = n.next;
+       else
+           wheel[n.level][n.slot] = n.next;
+       if (n.next != Nil)
+           nodes[n.next].prev = n.prev;
+       n.prev = n.next = Nil;
+       n.linked = false;
+   }
+
+   // Called with the mutex held.
+   void release(uint32_t index) {
+       Node& n = nodes[index];
+       n.fn.reset();
+       ++n.generation;
+       n.next = freeList;
+       freeList = index;
+       --active;
+   }
+
+   // Takes the whole list out of a slot.
+   uint32_t detach(int level, uint32_t slot) {
+       uint32_t head = wheel[level][slot];
+       wheel[level][slot] = Nil;
+       for (uint32_t i = head; i != Nil; i = nodes[i].next)
+           nodes[i].linked = false;
+       return head;
+   }
+
+   // One tick. Due callbacks are appended to `due`. Called with the mutex held.
+   void advance(std::vector<std::shared_ptr<std::function<void()>>>& due) {
+       ++currentTick;
+       uint32_t slot0 = currentTick & (Slots - 1);
+
+       // Cascade : whenever a level wraps, pull the next slot of the level above down.
+       for (int level = 1; level < Levels; ++level) {
+           if (((currentTick >> (SlotBits * (level - 1))) & (Slots - 1)) != 0)
+               break;
+           uint32_t slot = (currentTick >> (SlotBits * level)) & (Slots - 1);
+           for (uint32_t i = detach(level, slot); i != Nil;) {
+               uint32_t next = nodes[i].next;
+               insert(i, true);
+               i = next;
+           }
+       }
+
+       for (uint32_t i = detach(0, slot0); i != Nil;) {
+           uint32_t next = nodes[i].next;
+           Node& n = nodes[i];
+           due.push_back(n.fn);
+           if (n.period) {
+               n.expires += n.period;
+               insert(i);
+           }
+           else {
+               release(i);
+           }
+           i = next;
+       }
+   }
+
+   void run() {
+       std::vector<std::shared_ptr<std::function<void()>>> due;
+       std::unique_lock<std::mutex> lock(mutex);
+       while (!stop) {
+           uint64_t target = ticksNow();
+           while (currentTick < target)
+               advance(due); // Catches up tick by tick if we woke up late.
+
+           if (!due.empty()) {
+               lock.unlock();
+               for (auto& fn : due)
+                   pool.enqueue([fn] { (*fn)(); });
+               due.clear();
+               lock.lock();
+               continue;
+           }
+
+           sleepUntil = active == 0 ? UINT64_MAX : nextWakeTick();
+           if (sleepUntil == UINT64_MAX)
+               wake.wait(lock);
+           else
+               wake.wait_until(lock, start + std::chrono::milliseconds(sleepUntil));
+       }
+   }
+
+   // First tick with a non-empty level 0 slot before level 0 wraps, else the wrap itself (where
+   // the cascade may bring timers down). Called with the mutex held.
+   uint64_t nextWakeTick() const {
+       uint64_t wrap = (currentTick | (Slots - 1)) + 1;
+       for (uint64_t tick = currentTick + 1; tick < wrap; ++tick)
+           if (wheel[0][tick & (Slots - 1)] != Nil)
+               return tick;
+       return wrap;
+   }
+
+   ThreadPool& pool;
+   Clock::time_point start;
+   uint64_t currentTick = 0;
+
+   std::array<std::array<uint32_t, Slots>, Levels> wheel;
+   std::vector<Node> nodes;
+   uint32_t freeList = Nil;
+   size_t active = 0;
+   uint64_t sleepUntil = UINT64_MAX; // Tick the timer thread waits for, UINT64_MAX = no deadline.
+
+   std::mutex mutex;
+   std::condition_variable wake;
+   bool stop = false;
+   std::thread timerThread;
+};
+
+int main() {
+   ThreadPool pool(4);
+   TimerWheel timers(pool, 100000);
+
+   // 1. Periodic job, instead of a thread looping on sleep_for.
+   std::atomic<int> heartbeats(0);
+   TimerId heartbeat = timers.schedule_every(std::chrono::milliseconds(100), [&heartbeats] { ++heartbeats; });
+
+   // 2. 100k one shot timers, then cancel every second one.
+   const int N = 100000;
+   std::atomic<int> fired(0);
+   std::atomic<long long> lateMs(0);
+   std::vector<TimerId> ids(N);
+   std::mt19937 rng(1);
+   auto begin = TimerWheel::Clock::now();
+
+   auto t0 = std::chrono::steady_clock::now();
+   for (int i = 0; i < N; ++i) {
+       auto delay = std::chrono::milliseconds(1 + rng() % 1500);
+       auto due = TimerWheel::Clock::now() + delay;
+       ids[i] = timers.schedule_after(delay, [&fired, &lateMs, due] {
+           ++fired;
+           lateMs += std::chrono::duration_cast<std::chrono::milliseconds>(TimerWheel::Clock::now() - due).count();
+       });
+   }
+   auto t1 = std::chrono::steady_clock::now();
+   int cancelled = 0;
+   for (int i = 0; i < N; i += 2)
+       cancelled += timers.cancel(ids[i]);
+   auto t2 = std::chrono::steady_clock::now();
+
+   auto ns = [](auto d) { return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count(); };
+   std::cout << "insert : " << ns(t1 - t0) / N << " ns/timer\n";
+   std::cout << "cancel : " << ns(t2 - t1) / (N / 2) << " ns/timer (" << cancelled << " still pending when cancelled)\n";
+
+   std::this_thread::sleep_for(std::chrono::milliseconds(1700));
+   int expected = N - cancelled;
+   std::cout << "fired  : " << fired.load() << " of " << expected << " expected, average lateness "
+             << (fired ? lateMs.load() / fired.load() : 0) << " ms\n";
+
+   timers.cancel(heartbeat);
+   auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(TimerWheel::Clock::now() - begin).count();
+   std::cout << "heartbeats : " << heartbeats.load() << " in " << elapsed << " ms, pending timers "
+             << timers.pending() << "\n";
+   return 0;
+}
@@ -0,0 +1,243 @@
+//****** Work Stealing Thread Pool ******//
+
+//NOTES :
+//1. ThreadPool.cpp keeps ONE std::queue guarded by ONE mutex. Every enqueue and every worker
+//   fights for that same lock, so with many workers and tiny tasks most time is spent waiting on it.
+//2. Work stealing gives every worker its own deque :
+//   a. Owner pushes and pops at the BACK  (LIFO) -> the task it just created is still hot in cache.
+//   b. Thieves steal from the FRONT        (FIFO) -> they take the oldest (usually biggest) work.
+//   c. A worker only touches another worker's deque when its own deque is empty.
+//3. Tasks enqueued from a worker thread go to that worker's deque, tasks enqueued from outside
+//   (e.g. main) are spread round robin over all deques.
+//4. No shared counter on the hot path : every deque publishes its own size (written under its own
+//   lock), thieves skip empty deques without locking them. A worker that finds nothing retries the
+//   steal a bounded number of times with a yield in between, then parks.
+//5. Parking is an "eventcount" : the worker registers as a waiter, reads the epoch, checks every
+//   deque once more, and only then sleeps until the epoch moves. Enqueue pays a fence and one load
+//   of the waiter count, and touches the sleep lock only when somebody is actually parked.
+//6. The enqueue(F&&) API is the same as ThreadPool.cpp, only the scheduling mode is new.
+
+//Compile : g++ -std=c++17 -O2 -pthread WorkStealingThreadPool.cpp
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <random>
+#include <chrono>
+
+enum class SchedulingMode {
+   CentralQueue, // One shared FIFO queue (same as ThreadPool.cpp).
+   WorkStealing  // One deque per worker + stealing.
+};
+
+class ThreadPool {
+public:
+   ThreadPool(size_t numThreads, SchedulingMode mode = SchedulingMode::CentralQueue)
+       : mode(mode), stop(false), waiters(0), epoch(0), queues(numThreads) {
+       for (size_t i = 0; i < numThreads; ++i) {
+           if (mode == SchedulingMode::CentralQueue)
+               workers.emplace_back([this] { centralLoop(); });
+           else
+               workers.emplace_back([this, i] { stealingLoop(i); });
+       }
+   }
+
+   template<class F>
+   void enqueue(F&& task) {
+       if (mode == SchedulingMode::CentralQueue) {
+           std::unique_lock<std::mutex> lock(queueMutex);
+           tasks.emplace(std::forward<F>(task));
+           lock.unlock();
+           condition.notify_one();
+           return;
+       }
+
+       // Worker threads push to their own deque, outside threads go round robin.
+       size_t index = (currentPool == this) ? currentIndex : roundRobin++ % queues.size();
+       WorkQueue& q = queues[index];
+       {
+           std::lock_guard<std::mutex> lock(q.mutex);
+           q.tasks.emplace_back(std::forward<F>(task));
+           q.size.store(q.tasks.size()); // seq_cst : pairs with the waiter registration, see wakeOne().
+       }
+       wakeOne();
+   }
+
+   ~ThreadPool() {
+       std::unique_lock<std::mutex> lock(queueMutex);
+       stop = true;
+       epoch.fetch_add(1);
+       lock.unlock();
+       condition.notify_all();
+       for (std::thread& worker : workers)
+           worker.join();
+   }
+
+private:
+   // Padded so two workers' deques never share a cache line.
+   struct alignas(64) WorkQueue {
+       std::mutex mutex;
+       std::deque<std::function<void()>> tasks;
+       std::atomic<size_t> size{0}; // Written under mutex, read without it.
+   };
+ 
+   static constexpr int kStealRounds = 32;
+
+   void centralLoop() {
+       for (;;) {
+           std::unique_lock<std::mutex> lock(queueMutex);
+           condition.wait(lock, [this] { return stop || !tasks.empty(); });
+           if (stop && tasks.empty())
+               return;
+           auto task = std::move(tasks.front());
+           tasks.pop();
+           lock.unlock();
+           task();
+       }
+   }
+
+   void stealingLoop(size_t index) {
+       currentPool = this;
+       currentIndex = index;
+       std::minstd_rand rng(static_cast<unsigned>(index + 1));
+       std::function<void()> task;
+       for (;;) {
+           bool found = popLocal(index, task);
+           for (int round = 0; !found && round < kStealRounds; ++round) {
+               found = steal(index, rng, task);
+               if (!found)
+                   std::this_thread::yield(); // Backoff : give the producer a chance.
+           }
+           if (found) {
+               task();
+               task = nullptr; // Destroy captures now, not when the next task arrives.
+               continue;
+           }
+
+           // Announce the wait, then look again : an enqueue after this point sees us and bumps the epoch.
+           waiters.fetch_add(1);
+           size_t seen = epoch.load();
+           if (hasWork()) {
+               waiters.fetch_sub(1);
+               continue;
+           }
+           std::unique_lock<std::mutex> lock(queueMutex);
+           condition.wait(lock, [this, seen] { return stop || epoch.load() != seen; });
+           waiters.fetch_sub(1);
+           if (stop && !hasWork())
+               return;
+       }
+   }
+ 
+   bool hasWork() const {
+       for (const WorkQueue& q : queues)
+           if (q.size.load() != 0)
+               return true;
+       return false;
+   }
+
+   // Owner side : LIFO from the back.
+   bool popLocal(size_t index, std::function<void()>& task) {
+       WorkQueue& q = queues[index];
+       std::lock_guard<std::mutex> lock(q.mutex);
+       if (q.tasks.empty())
+           return false;
+       task = std::move(q.tasks.back());
+       q.tasks.pop_back();
+       q.size.store(q.tasks.size(), std::memory_order_relaxed);
+       return true;
+   }
+
+   // Thief side : FIFO from the front of a random victim, then walk the others.
+   bool steal(size_t self, std::minstd_rand& rng, std::function<void()>& task) {
+       size_t count = queues.size();
+       size_t start = rng() % count;
+       for (size_t n = 0; n < count; ++n) {
+           size_t victim = (start + n) % count;
+           if (victim == self)
+               continue;
+           WorkQueue& q = queues[victim];
+           if (q.size.load(std::memory_order_relaxed) == 0)
+               continue; // Empty : not even worth a try_lock.
+           std::unique_lock<std::mutex> lock(q.mutex, std::try_to_lock);
+           if (!lock.owns_lock() || q.tasks.empty())
+               continue;
+           task = std::move(q.tasks.front());
+           q.tasks.pop_front();
+           q.size.store(q.tasks.size(), std::memory_order_relaxed);
+           return true;
+       }
+       return false;
+   }
+
+   void wakeOne() {
+       // Our size store and the worker's waiters.fetch_add are both seq_cst : either we see the
+       // waiter here, or its hasWork() sees our task.
+       if (waiters.load() == 0)
+           return;
+       {
+           std::lock_guard<std::mutex> lock(queueMutex);
+           epoch.fetch_add(1);
+       }
+       condition.notify_one();
+   }
+
+   SchedulingMode mode;
+   std::vector<std::thread> workers;
+   std::queue<std::function<void()>> tasks;
+
+   std::mutex queueMutex;
+   std::condition_variable condition;
+   bool stop;
+
+   std::atomic<size_t> waiters;
+   std::atomic<size_t> epoch;
+   std::vector<WorkQueue> queues;
+
+   static thread_local ThreadPool* currentPool;
+   static thread_local size_t currentIndex;
+   static thread_local size_t roundRobin; // Per producer thread : no shared counter.
+};
+
+thread_local ThreadPool* ThreadPool::currentPool = nullptr;
+thread_local size_t ThreadPool::currentIndex = 0;
+thread_local size_t ThreadPool::roundRobin = 0;
+
+// Benchmark : every task is tiny and spawns a few children, so the pool itself is the bottleneck.
+double tasksPerSecond(size_t numThreads, SchedulingMode mode, int rootTasks, int fanOut) {
+   std::atomic<long> done(0);
+   long total = static_cast<long>(rootTasks) * (1 + fanOut);
+   auto begin = std::chrono::steady_clock::now();
+   {
+       ThreadPool pool(numThreads, mode);
+       for (int i = 0; i < rootTasks; ++i) {
+           pool.enqueue([&pool, &done, fanOut] {
+               for (int c = 0; c < fanOut; ++c)
+                   pool.enqueue([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+               done.fetch_add(1, std::memory_order_relaxed);
+           });
+       }
+       while (done.load() < total)
+           std::this_thread::yield();
+   }
+   std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+   return total / elapsed.count();
+}
+
+int main() {
+   const int rootTasks = 20000, fanOut = 9;
+
+   std::cout << "Workers   CentralQueue(tasks/s)   WorkStealing(tasks/s)\n";
+   for (size_t n : { 1, 4, 8, 16, 32 }) {
+       double central = tasksPerSecond(n, SchedulingMode::CentralQueue, rootTasks, fanOut);
+       double stealing = tasksPerSecond(n, SchedulingMode::WorkStealing, rootTasks, fanOut);
+       printf("%7zu   %21.0f   %21.0f\n", n, central, stealing);
+   }
+   return 0;
+}